@@ -40,11 +40,15 @@
 #include "notify.h"
 #include "prefs.h"
 
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <math.h>
+#include <gio/gio.h>
 #include <alsa/asoundlib.h>
 #include <string.h>
 
 #define MAX_LINEAR_DB_SCALE	24
+#define NORM_CURVE_SIZE	101
 
 static inline gboolean
 use_linear_dB_scale(long dBmin, long dBmax)
@@ -52,13 +56,72 @@ use_linear_dB_scale(long dBmin, long dBmax)
 	return dBmax - dBmin <= MAX_LINEAR_DB_SCALE * 100;
 }
 
+/**
+ * Cached state of the mixer element in use. Ranges and capabilities
+ * are loaded once when the element is opened, the values are refreshed
+ * once per alsa event or write. This way getvol() and ismuted() are
+ * simple lookups and don't have to query alsa every time.
+ */
+struct elem_state {
+	/**
+	 * Playback volume range.
+	 */
+	long pmin, pmax;
+	/**
+	 * Playback dB range, only meaningful if has_dB is set.
+	 */
+	long dBmin, dBmax;
+	/**
+	 * Whether the element has a usable dB range.
+	 */
+	gboolean has_dB;
+	/**
+	 * Whether the element has a playback switch.
+	 */
+	gboolean has_playback_switch;
+	/**
+	 * Volume curve for the NormalizeVolume mode, only meaningful if
+	 * has_dB is set. norm_curve[p] is the lowest raw volume whose
+	 * normalized volume is p or more, norm_curve[NORM_CURVE_SIZE]
+	 * is pmax + 1. It is built by build_norm_curve().
+	 */
+	long norm_curve[NORM_CURVE_SIZE + 1];
+	/**
+	 * Current raw playback volume.
+	 */
+	long raw;
+	/**
+	 * Whether all the playback channels are at raw. Writes set all
+	 * of them at once, so writing raw isn't a no-op otherwise.
+	 */
+	gboolean raw_uniform;
+	/**
+	 * Current playback volume in the 0-100 range.
+	 */
+	int volume;
+	/**
+	 * Current normalized playback volume in the 0-100 range.
+	 */
+	int norm_volume;
+	/**
+	 * Current playback switch, 0 if muted, 1 otherwise.
+	 */
+	int playback_switch;
+};
+
 static int smixer_level = 0;
 static struct snd_mixer_selem_regopt smixer_options;
 static snd_mixer_elem_t *elem;
 static snd_mixer_t *handle;
+static struct elem_state estate;
 struct acard *active_card;
 
 static GSList *get_channels(const char *card);
+static void schedule_rebind(gboolean disconnected);
+static void build_group(void);
+static void clear_group(void);
+static void update_group_offsets(void);
+static void cancel_ramp(void);
 
 static long
 lrint_dir(double x, int dir)
@@ -87,32 +150,275 @@ card_free(gpointer data)
 	g_free(data);
 }
 
+/**
+ * Allocates a new card, with its channel list not loaded yet.
+ *
+ * @param name the real card name
+ * @param dev the HCTL device name
+ * @return the newly allocated card, to be freed with card_free()
+ */
+static struct acard *
+card_new(const char *name, const char *dev)
+{
+	struct acard *card = g_malloc(sizeof(struct acard));
+	card->name = g_strdup(name);
+	card->dev = g_strdup(dev);
+	card->channels = NULL;
+	card->channels_loaded = FALSE;
+	return card;
+}
+
+/**
+ * Fingerprint of the sound devices, matching the card list
+ * currently in use. NULL if it couldn't be computed.
+ */
+static gchar *cards_fingerprint = NULL;
+
+/**
+ * Computes a cheap fingerprint of the sound devices present on the
+ * system, from the content of /proc/asound/cards and the modification
+ * times of the alsa configuration files (which may redefine the
+ * 'default' device).
+ *
+ * @return the fingerprint, newly allocated, or NULL on failure
+ */
+static gchar *
+get_cards_fingerprint(void)
+{
+	GChecksum *checksum;
+	gchar *contents, *fingerprint, *asoundrc;
+	const gchar *confs[2];
+	gsize len;
+	guint i;
+
+	if (!g_file_get_contents("/proc/asound/cards", &contents, &len, NULL))
+		return NULL;
+
+	checksum = g_checksum_new(G_CHECKSUM_MD5);
+	g_checksum_update(checksum, (const guchar *) contents, len);
+	g_free(contents);
+
+	asoundrc = g_build_filename(g_get_home_dir(), ".asoundrc", NULL);
+	confs[0] = "/etc/asound.conf";
+	confs[1] = asoundrc;
+	for (i = 0; i < G_N_ELEMENTS(confs); i++) {
+		struct stat st;
+		gint64 mtime = 0;
+
+		if (stat(confs[i], &st) == 0)
+			mtime = st.st_mtime;
+		g_checksum_update(checksum, (const guchar *) &mtime, sizeof(mtime));
+	}
+	g_free(asoundrc);
+
+	fingerprint = g_strdup(g_checksum_get_string(checksum));
+	g_checksum_free(checksum);
+
+	return fingerprint;
+}
+
+/**
+ * Get the path of the card cache file.
+ *
+ * @return the path, newly allocated
+ */
+static gchar *
+get_cards_cache_file(void)
+{
+	return g_build_filename(g_get_user_cache_dir(), "pnmixer", "cards", NULL);
+}
+
+/**
+ * Fills the global GSList 'cards' from the cache file, if it exists
+ * and matches the current fingerprint.
+ *
+ * @return TRUE if the card list was loaded from the cache, FALSE otherwise
+ */
+static gboolean
+load_cards_cache(void)
+{
+	GKeyFile *cache;
+	gchar *filename, *fingerprint, **groups;
+	gsize i;
+	gboolean ret = FALSE;
+
+	if (cards_fingerprint == NULL)
+		return FALSE;
+
+	cache = g_key_file_new();
+	filename = get_cards_cache_file();
+	if (!g_key_file_load_from_file(cache, filename, 0, NULL))
+		goto out;
+
+	fingerprint = g_key_file_get_string(cache, "Cache", "Fingerprint", NULL);
+	ret = !g_strcmp0(fingerprint, cards_fingerprint);
+	g_free(fingerprint);
+	if (!ret) {
+		DEBUG_PRINT("Card cache is outdated");
+		goto out;
+	}
+
+	groups = g_key_file_get_groups(cache, NULL);
+	for (i = 0; groups[i]; i++) {
+		struct acard *card;
+		gchar *name, **channels;
+		gsize j, n;
+
+		if (!strcmp(groups[i], "Cache"))
+			continue;
+
+		name = g_key_file_get_string(cache, groups[i], "Name", NULL);
+		if (name == NULL)
+			continue;
+		card = card_new(name, groups[i]);
+		g_free(name);
+
+		channels = g_key_file_get_string_list(cache, groups[i],
+						      "Channels", &n, NULL);
+		if (channels) {
+			for (j = 0; j < n; j++)
+				card->channels = g_slist_append(card->channels,
+								g_strdup(channels[j]));
+			card->channels_loaded = TRUE;
+			g_strfreev(channels);
+		}
+
+		cards = g_slist_append(cards, card);
+	}
+	g_strfreev(groups);
+
+	DEBUG_PRINT("Card list loaded from cache '%s'", filename);
+
+	/* the cache must at least hold the default card */
+	if (cards == NULL)
+		ret = FALSE;
+
+out:
+	g_free(filename);
+	g_key_file_free(cache);
+	return ret;
+}
+
+/**
+ * How long (in ms) to wait before writing the cache file, so that
+ * enumerating the channels of several cards in a row (e.g. when
+ * opening the preferences window) causes only one write.
+ */
+#define CARDS_CACHE_SAVE_DELAY 1000
+
+/**
+ * Source id of the pending write of the cache file, or 0.
+ */
+static guint cards_cache_save_id = 0;
+
+/**
+ * Writes the global GSList 'cards' to the cache file, along with
+ * the current fingerprint. Channel lists are saved only for
+ * the cards where they have been loaded.
+ */
+static void
+write_cards_cache(void)
+{
+	GKeyFile *cache;
+	GSList *item;
+	gchar *filename, *dirname, *data;
+	gsize len;
+
+	if (cards_fingerprint == NULL)
+		return;
+
+	cache = g_key_file_new();
+	g_key_file_set_string(cache, "Cache", "Fingerprint", cards_fingerprint);
+
+	for (item = cards; item; item = item->next) {
+		struct acard *card = item->data;
+
+		g_key_file_set_string(cache, card->dev, "Name", card->name);
+
+		if (card->channels_loaded) {
+			GSList *chan;
+			const gchar **channels;
+			gsize n = 0;
+
+			channels = g_new(const gchar *, g_slist_length(card->channels) + 1);
+			for (chan = card->channels; chan; chan = chan->next)
+				channels[n++] = chan->data;
+			channels[n] = NULL;
+			g_key_file_set_string_list(cache, card->dev, "Channels",
+						   channels, n);
+			g_free(channels);
+		}
+	}
+
+	filename = get_cards_cache_file();
+	dirname = g_path_get_dirname(filename);
+	data = g_key_file_to_data(cache, &len, NULL);
+
+	if (g_mkdir_with_parents(dirname, S_IRWXU) == 0)
+		g_file_set_contents(filename, data, len, NULL);
+
+	g_free(data);
+	g_free(dirname);
+	g_free(filename);
+	g_key_file_free(cache);
+}
+
+/**
+ * Writes the cache file.
+ * This function is attached via g_timeout_add() in save_cards_cache().
+ *
+ * @param data unused
+ * @return FALSE, so the source is removed
+ */
+static gboolean
+cards_cache_timeout(G_GNUC_UNUSED gpointer data)
+{
+	cards_cache_save_id = 0;
+	write_cards_cache();
+	return FALSE;
+}
+
+/**
+ * Schedules a write of the cache file, unless one is already pending.
+ */
+static void
+save_cards_cache(void)
+{
+	if (cards_cache_save_id == 0)
+		cards_cache_save_id = g_timeout_add(CARDS_CACHE_SAVE_DELAY,
+						    cards_cache_timeout, NULL);
+}
+
+/**
+ * Writes the cache file now if a write is pending.
+ */
+static void
+flush_cards_cache(void)
+{
+	if (cards_cache_save_id == 0)
+		return;
+
+	g_source_remove(cards_cache_save_id);
+	cards_cache_save_id = 0;
+	write_cards_cache();
+}
+
 /**
  * Partly based on get_cards function in alsamixer.
- * This gets all alsa cards and fills the global
- * GSList 'cards'.
- * The list always starts with the 'default' card.
+ * This enumerates all alsa cards and appends them to the
+ * global GSList 'cards'.
+ *
+ * This only opens a control handle for each card, to get its name.
+ * Channels are enumerated later on, when get_card_channels() is
+ * called, because it implies opening and loading a whole mixer.
  */
 static void
-get_cards(void)
+enumerate_cards(void)
 {
 	int err, num;
 	snd_ctl_card_info_t *info;
 	snd_ctl_t *ctl;
 	char buf[10];
-	struct acard *cur_card, *default_card;
-
-	if (cards != NULL)
-		g_slist_free_full(cards, card_free);
-
-	cards = NULL;
-
-	default_card = g_malloc(sizeof(struct acard));
-	default_card->name = g_strdup("(default)");
-	default_card->dev = g_strdup("default");
-	default_card->channels = get_channels("default");
-
-	cards = g_slist_append(cards, default_card);
 
 	// don't need to free this as it's alloca'd
 	snd_ctl_card_info_alloca(&info);
@@ -132,21 +438,46 @@ get_cards(void)
 		snd_ctl_close(ctl);
 		if (err < 0)
 			continue;
-		cur_card = g_malloc(sizeof(struct acard));
-		cur_card->name = g_strdup(snd_ctl_card_info_get_name(info));
-		sprintf(buf, "hw:%d", num);
-		cur_card->dev = g_strdup(buf);
-		cur_card->channels = get_channels(buf);
-		cards = g_slist_append(cards, cur_card);
+		cards = g_slist_append(cards,
+				       card_new(snd_ctl_card_info_get_name(info), buf));
+	}
+}
+
+/**
+ * This gets all alsa cards and fills the global
+ * GSList 'cards'.
+ * The list always starts with the 'default' card.
+ *
+ * If the sound devices didn't change since the last run, the card
+ * list (including the channels that were enumerated) is loaded from
+ * the cache file. Otherwise the cards are enumerated.
+ */
+static void
+get_cards(void)
+{
+	if (cards != NULL)
+		g_slist_free_full(cards, card_free);
+
+	cards = NULL;
+
+	g_free(cards_fingerprint);
+	cards_fingerprint = get_cards_fingerprint();
+
+	if (!load_cards_cache()) {
+		if (cards != NULL)
+			g_slist_free_full(cards, card_free);
+		cards = g_slist_append(NULL, card_new("(default)", "default"));
+		enumerate_cards();
+		save_cards_cache();
 	}
+
 	if (want_debug == TRUE) {
 		GSList *tmp = cards;
 		if (tmp) {
 			printf("------ Card list ------\n");
 			while (tmp) {
 				struct acard *c = tmp->data;
-				printf("\t%s\t%s\t%s\n", c->dev, c->name,
-					   c->channels ? "" : "No chann");
+				printf("\t%s\t%s\n", c->dev, c->name);
 				tmp = tmp->next;
 			}
 			printf("-----------------------\n");
@@ -154,6 +485,25 @@ get_cards(void)
 	}
 }
 
+/**
+ * Get the playable channels of a card. They are enumerated
+ * the first time this function is called for a given card.
+ *
+ * @param card the card to get the channels of
+ * @return the GSList of channels, NULL if there is none
+ */
+GSList *
+get_card_channels(struct acard *card)
+{
+	if (!card->channels_loaded) {
+		card->channels = get_channels(card->dev);
+		card->channels_loaded = TRUE;
+		save_cards_cache();
+	}
+
+	return card->channels;
+}
+
 /**
  * Get the acard struct corresponding to a card name
  * by searching the global GSList 'cards'.
@@ -223,131 +573,477 @@ open_mixer(const char *card, struct snd_mixer_selem_regopt *opts, int level)
 }
 
 /**
- * Callback function for the mixer element which is
- * set in alsaset().
+ * Get the normalized volume from a dB value, according to the
+ * cached dB range of the element.
  *
- * @param e mixer element
- * @param mask event mask
- * @return 0 on success otherwise a negative error code
+ * @param st the cached state of the element
+ * @param value the dB value
+ * @return normalized volume, from 0 to 1.0
  */
-static int
-alsa_cb(G_GNUC_UNUSED snd_mixer_elem_t *e, unsigned int mask)
+static double
+normalize_dB(const struct elem_state *st, long value)
 {
-	/* Test MASK_REMOVE first, according to Alsa documentation */
-	if (mask == SND_CTL_EVENT_MASK_REMOVE) {
-		return 0;
-	}
+	long min = st->dBmin, max = st->dBmax;
+	double normalized, min_norm;
 
-	/* Then check if mixer value changed */
-	if (mask & SND_CTL_EVENT_MASK_VALUE) {
-		int muted;
-		get_current_levels();
-		muted = ismuted();
-		on_volume_has_changed();
-		if (enable_noti && external_noti) {
-			int vol = getvol();
-			if (muted)
-				do_notify_volume(vol, FALSE);
-			else
-				do_notify_volume(vol, TRUE);
-		}
+	if (use_linear_dB_scale(min, max))
+		return (value - min) / (double) (max - min);
+
+	normalized = exp10((value - max) / 6000.0);
+	if (min != SND_CTL_TLV_DB_GAIN_MUTE) {
+		min_norm = exp10((min - max) / 6000.0);
+		normalized = (normalized - min_norm) / (1 - min_norm);
 	}
 
-	return 0;
+	return normalized;
 }
 
 /**
- * We need to re-init alsa in an idle moment, it doesn't seem
- * very safe to do that while handling data in poll_cb().
- * This function is attached via g_idle_add() in poll_cb().
+ * Converts the current volume in the real volume range
+ * reported by snd_mixer_selem_get_playback_volume_range()
+ * into the 0-100 range.
  *
- * @param data passed to the function,
- * set when the source was created
- * @return FALSE if the source should be removed,
- * TRUE otherwise
+ * @param val current volume value
+ * @param min current minimum volume
+ * @param max current maximum volume
+ * @return volume converted into 0-100 range
  */
-static gboolean
-idle_alsa_reinit(G_GNUC_UNUSED gpointer data)
+static int
+convert_prange(long val, long min, long max)
 {
-	do_alsa_reinit();
-	return FALSE;
+	long range = max - min;
+	if (range == 0)
+		return 0;
+	val -= min;
+	return rint(val / (double) range * 100);
 }
 
-static gchar sbuf[256];
-static GIOChannelError *serr = NULL;
-static gsize sread = 1;
-
 /**
- * Callback function for external volume changes,
- * set in set_io_watch().
+ * Loads the ranges and capabilities of the mixer element
+ * into the cached state. This needs to be done whenever
+ * a new element is selected, or when alsa tells us that
+ * the element info changed.
  *
- * @param source the GIOChannel event source
- * @param condition the condition which has been satisfied
- * @param data user data set inb g_io_add_watch() or g_io_add_watch_full()
- * @return FALSE if the event source should be removed
+ * @param e the mixer element
+ * @param st the cached state of the element
+ * @return TRUE if the ranges changed, FALSE otherwise
  */
 static gboolean
-poll_cb(GIOChannel *source, GIOCondition condition, G_GNUC_UNUSED gpointer data)
+load_elem_caps(snd_mixer_elem_t *e, struct elem_state *st)
 {
-	snd_mixer_handle_events(handle);
+	long pmin = 0, pmax = 0, min, max;
+	gboolean has_dB, changed;
+	int err;
 
-	if (condition == G_IO_ERR) {
-		/* This happens when the file descriptor we're watching disappeared.
-		 * For example, if the USB soundcard has been unplugged.
-		 * In this case, reloading alsa is the nice thing to do, it will
-		 * cause PNMixer to select the first card available.
-		 */
-		do_notify_text(_("Soundcard disconnected"),
-			       _("Soundcard has been disconnected, reloading Alsa..."));
-		g_idle_add(idle_alsa_reinit, NULL);
-		return FALSE;
-	}
-	sread = 1;
-	while (sread) {
-		/* This handles the case where alsa_cb doesn't read all the data on
-		 * source. If we don't clear it out we'll go into an infinite
-		 * callback loop since there will be data on the channel forever.
-		 */
-		GIOStatus stat =
-			g_io_channel_read_chars(source, sbuf, 256,
-						&sread, (GError **) & serr);
-		if (serr) {
-			g_error_free((GError *) serr);
-			serr = NULL;
-		}
-		// normal, means alsa_cb cleared out the channel
-		if (stat == G_IO_STATUS_AGAIN)
-			continue;
-		// actually bad, alsa failed to clear channel
-		else if (stat == G_IO_STATUS_NORMAL)
-			warn_sound_conn_lost();
-		else if (stat == G_IO_STATUS_ERROR || stat == G_IO_STATUS_EOF)
-			report_error("Error: GIO error has occured. Won't respond to "
-				     "external volume changes anymore.");
-		else
-			report_error("Error: Unknown status from "
-				     "g_io_channel_read_chars.");
-		return TRUE;
-	}
-	return TRUE;
+	st->has_playback_switch = snd_mixer_selem_has_playback_switch(e);
+
+	snd_mixer_selem_get_playback_volume_range(e, &pmin, &pmax);
+	err = snd_mixer_selem_get_playback_dB_range(e, &min, &max);
+	has_dB = err >= 0 && min < max;
+
+	changed = pmin != st->pmin || pmax != st->pmax ||
+		  has_dB != st->has_dB ||
+		  (has_dB && (min != st->dBmin || max != st->dBmax));
+
+	st->pmin = pmin;
+	st->pmax = pmax;
+	st->has_dB = has_dB;
+	st->dBmin = min;
+	st->dBmax = max;
+
+	DEBUG_PRINT("[elem] range: %li - %li, dB range: %s%li - %li, switch: %s",
+		    st->pmin, st->pmax, st->has_dB ? "" : "(none) ",
+		    st->dBmin, st->dBmax,
+		    st->has_playback_switch ? "yes" : "no");
+
+	return changed;
 }
 
-// PCOUNT_MAX is a very arbitrary value.
-// The number of poll descriptors I witnessed has always been one.
-#define PCOUNT_MAX 8
-guint gio_watch_ids[PCOUNT_MAX] = { 0 };
+/**
+ * Computes the normalized volume of a raw volume value, using
+ * the dB information (TLV data) of the element.
+ * Only used to build the volume curve.
+ *
+ * @param e the mixer element
+ * @param st the cached state of the element
+ * @param raw the raw volume value
+ * @return normalized volume in the 0-100 range
+ */
+static int
+raw_to_norm_slow(snd_mixer_elem_t *e, const struct elem_state *st,
+		 long raw)
+{
+	long dB;
+	int norm;
+
+	if (snd_mixer_selem_ask_playback_vol_dB(e, raw, &dB) < 0)
+		return 0;
+
+	norm = lrint(normalize_dB(st, dB) * 100);
+	return CLAMP(norm, 0, 100);
+}
 
 /**
- * Sets the io watch for external volume changes
- * and registers the poll_cb() callback function.
+ * Builds the volume curve used in NormalizeVolume mode from the
+ * dB range and the TLV data of the element. Each entry is found
+ * with a binary search over the raw range, so this costs at most
+ * a few thousands of (local) dB conversions, and it's done only
+ * once per element.
  *
- * @param mixer mixer handle
+ * @param e the mixer element
+ * @param st the cached state of the element
  */
 static void
-set_io_watch(snd_mixer_t *mixer)
+build_norm_curve(snd_mixer_elem_t *e, struct elem_state *st)
 {
-	int i, pcount;
-	struct pollfd fds[PCOUNT_MAX];
+	long *curve = st->norm_curve;
+	long lo, hi, mid;
+	int p;
+
+	if (!st->has_dB)
+		return;
+
+	curve[0] = st->pmin;
+	curve[NORM_CURVE_SIZE] = st->pmax + 1;
+
+	lo = st->pmin;
+	for (p = 1; p < NORM_CURVE_SIZE; p++) {
+		/* the curve is monotonic, start from the previous entry */
+		hi = st->pmax + 1;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (raw_to_norm_slow(e, st, mid) >= p)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		curve[p] = lo;
+	}
+}
+
+/**
+ * Looks up the normalized volume of a raw volume value in the
+ * volume curve.
+ *
+ * @param st the cached state of the element
+ * @param raw the raw volume value
+ * @return normalized volume in the 0-100 range
+ */
+static int
+curve_raw_to_norm(const struct elem_state *st, long raw)
+{
+	const long *curve = st->norm_curve;
+	int lo = 0, hi = NORM_CURVE_SIZE - 1, mid;
+
+	/* find the last entry which is <= raw */
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (curve[mid] <= raw)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return lo;
+}
+
+/**
+ * Looks up the raw volume value matching a normalized volume
+ * in the volume curve. If the normalized volume can be reached
+ * exactly, the returned raw value gives back that same normalized
+ * volume, and it's the current raw value if that one already does,
+ * so that setvol(getvol()) is a fixed point.
+ *
+ * @param st the cached state of the element
+ * @param norm the normalized volume in the 0-100 range
+ * @param dir select direction (-1 = accurate or first bellow, 0 = accurate
+ * or nearest, 1 = accurate or first above)
+ * @return the raw volume value
+ */
+static long
+curve_norm_to_raw(const struct elem_state *st, int norm, int dir)
+{
+	const long *curve = st->norm_curve;
+	long above, below;
+
+	norm = CLAMP(norm, 0, 100);
+
+	/* raw values in [curve[norm], curve[norm + 1]) match exactly */
+	if (curve[norm] < curve[norm + 1]) {
+		if (curve[norm] <= st->raw && st->raw < curve[norm + 1])
+			return st->raw;
+		return dir < 0 ? curve[norm + 1] - 1 : curve[norm];
+	}
+
+	/* norm falls between two hardware steps */
+	above = curve[norm];
+	below = above - 1;
+	if (above > st->pmax)
+		return st->pmax;
+	if (dir > 0)
+		return above;
+	if (dir < 0)
+		return below;
+	if (curve_raw_to_norm(st, above) - norm <
+	    norm - curve_raw_to_norm(st, below))
+		return above;
+	return below;
+}
+
+/**
+ * Updates the cached volumes from a raw volume value.
+ *
+ * @param st the cached state of the element
+ * @param raw the raw volume value
+ */
+static void
+set_elem_state_raw(struct elem_state *st, long raw)
+{
+	st->raw = raw;
+	st->raw_uniform = TRUE;
+	st->volume = convert_prange(raw, st->pmin, st->pmax);
+
+	if (st->has_dB)
+		st->norm_volume = curve_raw_to_norm(st, raw);
+	else
+		st->norm_volume = st->volume;
+}
+
+/**
+ * Checks whether writing a raw volume value would leave the
+ * element unchanged.
+ *
+ * @param st the cached state of the element
+ * @param raw the raw volume value
+ * @return TRUE if all the playback channels are already at raw
+ */
+static gboolean
+elem_state_is_raw(const struct elem_state *st, long raw)
+{
+	return st->raw_uniform && st->raw == raw;
+}
+
+/**
+ * Reads the current values of the mixer element from alsa
+ * and updates the cached state. Called once per alsa event.
+ *
+ * @param e the mixer element
+ * @param st the cached state of the element
+ */
+static void
+refresh_elem_state(snd_mixer_elem_t *e, struct elem_state *st)
+{
+	snd_mixer_selem_channel_id_t ch;
+	long raw = st->pmin, ch_raw;
+
+	snd_mixer_selem_get_playback_volume(e, SND_MIXER_SCHN_FRONT_RIGHT,
+					    &raw);
+	set_elem_state_raw(st, raw);
+
+	for (ch = 0; ch <= SND_MIXER_SCHN_LAST; ch++) {
+		if (!snd_mixer_selem_has_playback_channel(e, ch))
+			continue;
+		if (snd_mixer_selem_get_playback_volume(e, ch, &ch_raw) >= 0 &&
+		    ch_raw != raw)
+			st->raw_uniform = FALSE;
+	}
+
+	st->playback_switch = 1;
+	if (st->has_playback_switch)
+		snd_mixer_selem_get_playback_switch(e, SND_MIXER_SCHN_FRONT_LEFT,
+						    &st->playback_switch);
+
+	DEBUG_PRINT("[elem] raw: %li  volume: %d  normalized: %d  switch: %d",
+		    st->raw, st->volume, st->norm_volume,
+		    st->playback_switch);
+}
+
+static guint external_flush_id = 0;
+
+/**
+ * Whether the pending flush_external_change() is for an external
+ * change, and should send a notification. It's not the case when
+ * it only refreshes the UI during a volume ramp.
+ */
+static gboolean external_flush_notify = FALSE;
+
+/**
+ * Propagates the last external volume change to the UI and sends
+ * a notification (if enabled). This is attached via g_timeout_add()
+ * in schedule_external_flush(), so that a burst of alsa events
+ * results in a single UI refresh, always showing the final value.
+ *
+ * @param data passed to the function,
+ * set when the source was created
+ * @return FALSE if the source should be removed,
+ * TRUE otherwise
+ */
+static gboolean
+flush_external_change(G_GNUC_UNUSED gpointer data)
+{
+	external_flush_id = 0;
+
+	get_current_levels();
+	on_volume_has_changed();
+	if (external_flush_notify && enable_noti && external_noti)
+		do_notify_volume(getvol(), ismuted() ? FALSE : TRUE,
+				 NOTI_SOURCE_EXTERNAL);
+	external_flush_notify = FALSE;
+
+	return FALSE;
+}
+
+/**
+ * Schedules flush_external_change() to only refresh the UI,
+ * unless it's already pending. The delay is given by the
+ * ExternalRefreshRate preference (in Hz), the default being
+ * about once per display frame.
+ */
+static void
+schedule_ui_flush(void)
+{
+	if (external_flush_id)
+		return;
+
+	external_flush_id = g_timeout_add(1000 / settings.external_refresh_rate,
+					  flush_external_change, NULL);
+}
+
+/**
+ * Schedules flush_external_change() for an external change,
+ * unless it's already pending.
+ */
+static void
+schedule_external_flush(void)
+{
+	external_flush_notify = TRUE;
+	schedule_ui_flush();
+}
+
+/**
+ * Cancels a pending flush_external_change(), if any.
+ */
+static void
+cancel_external_flush(void)
+{
+	if (external_flush_id == 0)
+		return;
+
+	g_source_remove(external_flush_id);
+	external_flush_id = 0;
+	external_flush_notify = FALSE;
+}
+
+/**
+ * Callback function for the mixer element which is
+ * set in alsaset(). It only updates the cached element state,
+ * the UI is refreshed later on by flush_external_change().
+ *
+ * @param e mixer element
+ * @param mask event mask
+ * @return 0 on success otherwise a negative error code
+ */
+static int
+alsa_cb(G_GNUC_UNUSED snd_mixer_elem_t *e, unsigned int mask)
+{
+	/* Test MASK_REMOVE first, according to Alsa documentation */
+	if (mask == SND_CTL_EVENT_MASK_REMOVE) {
+		return 0;
+	}
+
+	/* Ranges may have changed */
+	if (mask & SND_CTL_EVENT_MASK_INFO) {
+		if (load_elem_caps(elem, &estate))
+			build_norm_curve(elem, &estate);
+	}
+
+	/* Then check if mixer value changed */
+	if (mask & (SND_CTL_EVENT_MASK_VALUE | SND_CTL_EVENT_MASK_INFO)) {
+		refresh_elem_state(elem, &estate);
+		schedule_external_flush();
+	}
+
+	return 0;
+}
+
+// PCOUNT_MAX is a very arbitrary value.
+// The number of poll descriptors I witnessed has always been one.
+#define PCOUNT_MAX 8
+guint gio_watch_ids[PCOUNT_MAX] = { 0 };
+
+static gchar sbuf[256];
+static GIOChannelError *serr = NULL;
+static gsize sread = 1;
+
+/**
+ * Callback function for external volume changes,
+ * set in set_io_watch().
+ *
+ * @param source the GIOChannel event source
+ * @param condition the condition which has been satisfied
+ * @param data user data set inb g_io_add_watch() or g_io_add_watch_full(),
+ * the index of the watch in gio_watch_ids
+ * @return FALSE if the event source should be removed
+ */
+static gboolean
+poll_cb(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	snd_mixer_handle_events(handle);
+
+	if (condition == G_IO_ERR) {
+		/* This happens when the file descriptor we're watching disappeared.
+		 * For example, if the USB soundcard has been unplugged.
+		 * In this case, opening another card is the nice thing to do,
+		 * the device watch takes care of updating the card list.
+		 */
+		do_notify_text(_("Soundcard disconnected"),
+			       _("Soundcard has been disconnected, reloading Alsa..."));
+		gio_watch_ids[GPOINTER_TO_INT(data)] = 0;
+		schedule_rebind(TRUE);
+		return FALSE;
+	}
+	sread = 1;
+	while (sread) {
+		/* This handles the case where alsa_cb doesn't read all the data on
+		 * source. If we don't clear it out we'll go into an infinite
+		 * callback loop since there will be data on the channel forever.
+		 */
+		GIOStatus stat =
+			g_io_channel_read_chars(source, sbuf, 256,
+						&sread, (GError **) & serr);
+		if (serr) {
+			g_error_free((GError *) serr);
+			serr = NULL;
+		}
+		// normal, means alsa_cb cleared out the channel
+		if (stat == G_IO_STATUS_AGAIN)
+			continue;
+		// actually bad, alsa failed to clear channel
+		else if (stat == G_IO_STATUS_NORMAL)
+			warn_sound_conn_lost();
+		else if (stat == G_IO_STATUS_ERROR || stat == G_IO_STATUS_EOF)
+			report_error("Error: GIO error has occured. Won't respond to "
+				     "external volume changes anymore.");
+		else
+			report_error("Error: Unknown status from "
+				     "g_io_channel_read_chars.");
+		return TRUE;
+	}
+	return TRUE;
+}
+
+
+/**
+ * Sets the io watch for external volume changes
+ * and registers the poll_cb() callback function.
+ *
+ * @param mixer mixer handle
+ */
+static void
+set_io_watch(snd_mixer_t *mixer)
+{
+	int i, pcount;
+	struct pollfd fds[PCOUNT_MAX];
 
 	pcount = snd_mixer_poll_descriptors_count(mixer);
 	assert(pcount <= PCOUNT_MAX);
@@ -362,7 +1058,7 @@ set_io_watch(snd_mixer_t *mixer)
 	for (i = 0; i < pcount; i++) {
 		GIOChannel *gioc = g_io_channel_unix_new(fds[i].fd);
 		gio_watch_ids[i] = g_io_add_watch(gioc, G_IO_IN | G_IO_ERR,
-						  poll_cb, NULL);
+						  poll_cb, GINT_TO_POINTER(i));
 		g_io_channel_unref(gioc);
 	}
 }
@@ -376,7 +1072,7 @@ unset_io_watch(void)
 	int i;
 	for (i = 0; i < PCOUNT_MAX; i++) {
 		if (gio_watch_ids[i] == 0)
-			break;
+			continue;
 		g_source_remove(gio_watch_ids[i]);
 		gio_watch_ids[i] = 0;
 	}
@@ -408,24 +1104,20 @@ close_mixer(snd_mixer_t *mixer, const char *card)
 }
 
 /**
- * Get all playable channels for a single alsa card and
+ * Get all playable channels of an opened mixer and
  * return them as a GSList.
  *
+ * @param mixer mixer handle
  * @param card HCTL name of the alsa card
  * @return the GSList of channels
  */
 static GSList *
-get_channels(const char *card)
+list_channels(snd_mixer_t *mixer, const char *card)
 {
 	int ccount, i;
-	snd_mixer_t *mixer;
 	snd_mixer_elem_t *telem;
 	GSList *channels = NULL;
 
-	mixer = open_mixer(card, NULL, 0);
-	if (mixer == NULL)
-		return NULL;
-
 	ccount = snd_mixer_get_count(mixer);
 	telem = snd_mixer_first_elem(mixer);
 
@@ -449,307 +1141,1587 @@ get_channels(const char *card)
 		}
 	}
 
+	return channels;
+}
+
+/**
+ * Get all playable channels for a single alsa card and
+ * return them as a GSList.
+ *
+ * @param card HCTL name of the alsa card
+ * @return the GSList of channels
+ */
+static GSList *
+get_channels(const char *card)
+{
+	snd_mixer_t *mixer;
+	GSList *channels;
+
+	mixer = open_mixer(card, NULL, 0);
+	if (mixer == NULL)
+		return NULL;
+
+	channels = list_channels(mixer, card);
+
 	close_mixer(mixer, card);
 
 	return channels;
 }
 
 /**
- * Initializes the alsa system by getting the cards
- * and channels and setting the io watch for external
- * volume changes.
+ * Opens the mixer of a card, and fills its channel list
+ * on the way if it's not done yet.
  *
- * @return 0 on success otherwise negative error code
+ * @param card the card to open
+ * @return the mixer handle, or NULL if the card can't be opened
+ * or has no playable channels
  */
-static int
-alsaset(void)
+static snd_mixer_t *
+open_card(struct acard *card)
 {
-	char *card_name;
-	char *channel;
+	snd_mixer_t *mixer;
 
-	// update list of available cards
-	DEBUG_PRINT("Getting available cards...");
-	get_cards();
-	assert(cards != NULL);
+	DEBUG_PRINT("Opening card '%s'...", card->dev);
+	smixer_options.device = card->dev;
+	mixer = open_mixer(card->dev, &smixer_options, smixer_level);
 
-	// get selected card
-	assert(active_card == NULL);
-	card_name = prefs_get_string("AlsaCard", NULL);
-	DEBUG_PRINT("Selected card: %s", card_name);
-	if (card_name) {
-		active_card = find_card(card_name);
-		g_free(card_name);
+	if (mixer && !card->channels_loaded) {
+		card->channels = list_channels(mixer, card->dev);
+		card->channels_loaded = TRUE;
+		save_cards_cache();
 	}
 
-	// if not available, use the default card
-	if (!active_card) {
-		DEBUG_PRINT("Using default soundcard");
-		active_card = cards->data;
+	if (mixer && !card->channels) {
+		close_mixer(mixer, card->dev);
+		mixer = NULL;
 	}
-	// If no playable channels, iterate on card list until a valid card is
-	// found.
-	// In most situations, the first card of the list (which is the
-	// Alsa default card) can be opened.
-	// However, in some situations the default card may be unavailable.
-	// For example, when it's an USB DAC, and it's disconnected.
-	if (!active_card->channels) {
-		GSList *item;
-		DEBUG_PRINT("Card '%s' has no playable channels, iterating on card list",
-			    active_card->dev);
-		for (item = cards; item; item = item->next) {
-			active_card = item->data;
-			if (active_card->channels)
+
+	return mixer;
+}
+
+/**
+ * A mixer open besides the one of the active card, along with its
+ * element, the cached state of the element and the io watches of
+ * the handle. It's either kept in the mixer pool, or a member of
+ * the volume group.
+ */
+struct side_mixer {
+	/**
+	 * HCTL name of the card, e.g. 'hw:0'.
+	 */
+	gchar *dev;
+	/**
+	 * The open mixer handle.
+	 */
+	snd_mixer_t *handle;
+	/**
+	 * The element in use: for a pooled mixer, the one that was
+	 * in use when the card was left.
+	 */
+	snd_mixer_elem_t *elem;
+	/**
+	 * Cached state of elem, still updated from alsa events.
+	 */
+	struct elem_state estate;
+	/**
+	 * Io watches of the handle, see set_side_watch().
+	 */
+	guint watch_ids[PCOUNT_MAX];
+	/**
+	 * Protects the handle and the fields below it, group members
+	 * are written from the threads of the group pool.
+	 */
+	GMutex lock;
+	/**
+	 * Volume offset of a group member, relative to the volume
+	 * of the card in use.
+	 */
+	int offset;
+	/**
+	 * Volume to write to a group member, -1 if none.
+	 */
+	int pending_vol;
+	/**
+	 * Playback switch to write to a group member, -1 if none.
+	 */
+	int pending_switch;
+	/**
+	 * Whether pending_vol is a normalized volume.
+	 */
+	gboolean pending_normalize;
+	/**
+	 * Whether a write of the group member is queued in the group pool.
+	 */
+	gboolean queued;
+};
+
+/**
+ * Mixers of the recently used cards, most recent first. It's only
+ * filled if the MixerPoolSize preference is set, in which case
+ * switching back to one of these cards doesn't need to open
+ * and load the mixer again.
+ */
+static GSList *mixer_pool = NULL;
+
+/**
+ * Members of the volume group, besides the active card.
+ * See VolumeGroup and build_group().
+ */
+static GSList *group_members = NULL;
+
+/**
+ * Allocates a side mixer for a mixer handle.
+ *
+ * @param dev HCTL name of the card
+ * @param mixer the mixer handle
+ * @return the new side mixer
+ */
+static struct side_mixer *
+side_mixer_new(const char *dev, snd_mixer_t *mixer)
+{
+	struct side_mixer *sm;
+
+	sm = g_new0(struct side_mixer, 1);
+	sm->dev = g_strdup(dev);
+	sm->handle = mixer;
+	sm->pending_vol = -1;
+	sm->pending_switch = -1;
+	g_mutex_init(&sm->lock);
+
+	return sm;
+}
+
+/**
+ * Frees a side mixer, without closing its handle.
+ *
+ * @param sm the side mixer
+ */
+static void
+side_mixer_forget(struct side_mixer *sm)
+{
+	if (sm == NULL)
+		return;
+
+	g_mutex_clear(&sm->lock);
+	g_free(sm->dev);
+	g_free(sm);
+}
+
+/**
+ * Callback function for the elements of the side mixers.
+ * It keeps the cached state of the element up to date, so that
+ * the levels of the cards not in use are known. It's invoked
+ * from side_poll_cb(), with the lock held.
+ *
+ * @param e mixer element
+ * @param mask event mask
+ * @return 0 on success otherwise a negative error code
+ */
+static int
+side_elem_cb(snd_mixer_elem_t *e, unsigned int mask)
+{
+	struct side_mixer *sm = snd_mixer_elem_get_callback_private(e);
+
+	if (mask == SND_CTL_EVENT_MASK_REMOVE)
+		return 0;
+
+	if (mask & SND_CTL_EVENT_MASK_INFO) {
+		if (load_elem_caps(e, &sm->estate))
+			build_norm_curve(e, &sm->estate);
+	}
+
+	if (mask & (SND_CTL_EVENT_MASK_VALUE | SND_CTL_EVENT_MASK_INFO))
+		refresh_elem_state(e, &sm->estate);
+
+	return 0;
+}
+
+/**
+ * Removes the io watches of a side mixer.
+ *
+ * @param sm the side mixer
+ */
+static void
+unset_side_watch(struct side_mixer *sm)
+{
+	int i;
+	for (i = 0; i < PCOUNT_MAX; i++) {
+		if (sm->watch_ids[i] == 0)
+			continue;
+		g_source_remove(sm->watch_ids[i]);
+		sm->watch_ids[i] = 0;
+	}
+}
+
+/**
+ * Closes a side mixer and frees it. Its element may still be
+ * unset, if the mixer was just opened and the channel it was
+ * opened for isn't on the card.
+ *
+ * @param sm the side mixer
+ */
+static void
+side_mixer_free(struct side_mixer *sm)
+{
+	unset_side_watch(sm);
+	if (sm->elem)
+		snd_mixer_elem_set_callback(sm->elem, NULL);
+	close_mixer(sm->handle, sm->dev);
+	side_mixer_forget(sm);
+}
+
+/**
+ * Callback function for events on the poll descriptors of a
+ * side mixer, set in set_side_watch(). Events are dispatched
+ * to side_elem_cb(). If the card went away, a pooled mixer is
+ * dropped from the pool, while the loss of a group member
+ * rebinds the active card, which rebuilds the group.
+ *
+ * @param source the GIOChannel event source
+ * @param condition the condition which has been satisfied
+ * @param data the side mixer
+ * @return FALSE if the event source should be removed
+ */
+static gboolean
+side_poll_cb(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	struct side_mixer *sm = data;
+	gsize n;
+
+	g_mutex_lock(&sm->lock);
+	snd_mixer_handle_events(sm->handle);
+	g_mutex_unlock(&sm->lock);
+
+	if (condition == G_IO_ERR) {
+		guint id = g_source_get_id(g_main_current_source());
+		int i;
+
+		DEBUG_PRINT("Card %s: side mixer disconnected", sm->dev);
+		for (i = 0; i < PCOUNT_MAX; i++)
+			if (sm->watch_ids[i] == id)
+				sm->watch_ids[i] = 0;
+
+		if (g_slist_find(mixer_pool, sm)) {
+			mixer_pool = g_slist_remove(mixer_pool, sm);
+			side_mixer_free(sm);
+		} else {
+			/* group threads may be using it, let alsaunset()
+			 * tear the group down */
+			schedule_rebind(FALSE);
+		}
+		return FALSE;
+	}
+
+	/* alsa reads the events itself, just make sure nothing is left */
+	while (g_io_channel_read_chars(source, sbuf, sizeof(sbuf), &n, NULL)
+	       == G_IO_STATUS_NORMAL && n > 0)
+		;
+
+	return TRUE;
+}
+
+/**
+ * Sets the io watches of a side mixer, and attaches side_elem_cb()
+ * to its element, so that the cached state of the element is kept
+ * up to date.
+ *
+ * @param sm the side mixer
+ */
+static void
+set_side_watch(struct side_mixer *sm)
+{
+	int i, pcount;
+	struct pollfd fds[PCOUNT_MAX];
+
+	snd_mixer_elem_set_callback_private(sm->elem, sm);
+	snd_mixer_elem_set_callback(sm->elem, side_elem_cb);
+
+	pcount = snd_mixer_poll_descriptors_count(sm->handle);
+	assert(pcount <= PCOUNT_MAX);
+	pcount = snd_mixer_poll_descriptors(sm->handle, fds, pcount);
+
+	for (i = 0; i < pcount; i++) {
+		GIOChannel *gioc = g_io_channel_unix_new(fds[i].fd);
+		sm->watch_ids[i] = g_io_add_watch(gioc, G_IO_IN | G_IO_ERR,
+						  side_poll_cb, sm);
+		g_io_channel_unref(gioc);
+	}
+}
+
+/**
+ * Looks for the side mixer of a card in a list.
+ *
+ * @param list the list of side mixers
+ * @param dev HCTL name of the card
+ * @return the side mixer, or NULL if the card is not in the list
+ */
+static struct side_mixer *
+find_side_mixer(GSList *list, const char *dev)
+{
+	GSList *item;
+
+	for (item = list; item; item = item->next) {
+		struct side_mixer *sm = item->data;
+		if (!strcmp(sm->dev, dev))
+			return sm;
+	}
+
+	return NULL;
+}
+
+/**
+ * Looks for the pooled mixer of a card.
+ *
+ * @param dev HCTL name of the card
+ * @return the pooled mixer, or NULL if the card is not in the pool
+ */
+static struct side_mixer *
+find_pooled_mixer(const char *dev)
+{
+	return find_side_mixer(mixer_pool, dev);
+}
+
+/**
+ * Closes the least recently used pooled mixers, so that there
+ * are no more than a given number of them.
+ *
+ * @param pool_size maximum number of mixers in the pool
+ */
+static void
+trim_mixer_pool(gint pool_size)
+{
+	while (g_slist_length(mixer_pool) > (guint) MAX(pool_size, 0)) {
+		GSList *last = g_slist_last(mixer_pool);
+		side_mixer_free(last->data);
+		mixer_pool = g_slist_delete_link(mixer_pool, last);
+	}
+}
+
+/**
+ * Puts the mixer of the active card into the pool, instead of
+ * closing it. The least recently used mixers are closed if the
+ * pool grows beyond MixerPoolSize.
+ *
+ * @param pool_size maximum number of mixers in the pool
+ */
+static void
+pool_active_mixer(gint pool_size)
+{
+	struct side_mixer *pm;
+
+	pm = side_mixer_new(active_card->dev, handle);
+	pm->elem = elem;
+	pm->estate = estate;
+	set_side_watch(pm);
+
+	DEBUG_PRINT("Card %s: keeping mixer open in the pool", pm->dev);
+	mixer_pool = g_slist_prepend(mixer_pool, pm);
+
+	trim_mixer_pool(pool_size);
+}
+
+/**
+ * Closes the pooled mixers beyond MixerPoolSize, after
+ * the preference changed.
+ */
+void
+alsa_trim_mixer_pool(void)
+{
+	trim_mixer_pool(settings.mixer_pool_size);
+}
+
+/**
+ * Takes the mixer of a card out of the pool, if it's there.
+ * The mixer is not watched anymore, it's up to the caller
+ * to use it as the active mixer or as a group member.
+ *
+ * @param dev HCTL name of the card
+ * @return the pooled mixer, to be freed with side_mixer_forget()
+ * once its handle has been taken over, or NULL
+ */
+static struct side_mixer *
+unpool_mixer(const char *dev)
+{
+	struct side_mixer *pm = find_pooled_mixer(dev);
+
+	if (pm == NULL)
+		return NULL;
+
+	DEBUG_PRINT("Card %s: reusing pooled mixer", dev);
+	mixer_pool = g_slist_remove(mixer_pool, pm);
+	unset_side_watch(pm);
+	snd_mixer_elem_set_callback(pm->elem, NULL);
+
+	return pm;
+}
+
+/**
+ * Closes the pooled mixer of a card, if any.
+ *
+ * @param dev HCTL name of the card
+ */
+static void
+drop_pooled_mixer(const char *dev)
+{
+	struct side_mixer *pm = find_pooled_mixer(dev);
+
+	if (pm == NULL)
+		return;
+
+	mixer_pool = g_slist_remove(mixer_pool, pm);
+	side_mixer_free(pm);
+}
+
+/**
+ * Closes all the pooled mixers.
+ */
+static void
+clear_mixer_pool(void)
+{
+	g_slist_free_full(mixer_pool, (GDestroyNotify) side_mixer_free);
+	mixer_pool = NULL;
+}
+
+/**
+ * Loads the capabilities and the state of 'elem', and
+ * attaches alsa_cb() to it.
+ */
+static void
+bind_elem(void)
+{
+	DEBUG_PRINT("Using channel '%s'", snd_mixer_selem_get_name(elem));
+	load_elem_caps(elem, &estate);
+	build_norm_curve(elem, &estate);
+	refresh_elem_state(elem, &estate);
+	snd_mixer_elem_set_callback(elem, alsa_cb);
+}
+
+/**
+ * Gets a mixer handle for a card, from the mixer pool if it's
+ * there, otherwise by opening the card.
+ *
+ * @param card the card
+ * @param pm where to store the pooled mixer the handle comes from,
+ * set to NULL if the card was opened
+ * @return the mixer handle, or NULL if the card can't be used
+ */
+static snd_mixer_t *
+acquire_card_mixer(struct acard *card, struct side_mixer **pm)
+{
+	*pm = unpool_mixer(card->dev);
+	if (*pm)
+		return (*pm)->handle;
+
+	return open_card(card);
+}
+
+/**
+ * Opens the selected card and channel from the card list
+ * and sets the io watch for external volume changes.
+ *
+ * @return 0 on success otherwise negative error code
+ */
+static int
+alsaset(void)
+{
+	char *card_name;
+	char *channel;
+	struct side_mixer *pm;
+
+	assert(cards != NULL);
+
+	// get selected card
+	assert(active_card == NULL);
+	card_name = prefs_get_string("AlsaCard", NULL);
+	DEBUG_PRINT("Selected card: %s", card_name);
+	if (card_name) {
+		active_card = find_card(card_name);
+		g_free(card_name);
+	}
+
+	// if not available, use the default card
+	if (!active_card) {
+		DEBUG_PRINT("Using default soundcard");
+		active_card = cards->data;
+	}
+	// Open the card straight away, the channels of the other cards
+	// are not needed yet.
+	// If no playable channels, iterate on card list until a valid card is
+	// found.
+	// In most situations, the first card of the list (which is the
+	// Alsa default card) can be opened.
+	// However, in some situations the default card may be unavailable.
+	// For example, when it's an USB DAC, and it's disconnected.
+	// If the card is in the mixer pool, its handle is ready to use.
+	handle = acquire_card_mixer(active_card, &pm);
+	if (!handle) {
+		GSList *item;
+		DEBUG_PRINT("Card '%s' has no playable channels, iterating on card list",
+			    active_card->dev);
+		for (item = cards; item; item = item->next) {
+			active_card = item->data;
+			if (!get_card_channels(active_card))
+				continue;
+			handle = acquire_card_mixer(active_card, &pm);
+			if (handle)
 				break;
 		}
 		assert(item != NULL);
 	}
-	// open card
-	DEBUG_PRINT("Opening card '%s'...", active_card->dev);
-	smixer_options.device = active_card->dev;
-	handle = open_mixer(active_card->dev, &smixer_options, smixer_level);
-	assert(handle != NULL);
+	assert(handle != NULL);
+
+	// Set the channel
+	// We have to handle the fact that the channel name defined
+	// in PNMixer configuration is not necessarily valid.
+	// For example, this may happen when the default alsa soundcard
+	// is modified. The channel names of the new default card may
+	// not match the channel names of the previous default card.
+	assert(elem == NULL);
+	channel = prefs_get_channel(active_card->name);
+	if (channel) {
+		snd_mixer_selem_id_t *sid;
+		snd_mixer_selem_id_alloca(&sid);
+		snd_mixer_selem_id_set_name(sid, channel);
+		elem = snd_mixer_find_selem(handle, sid);
+		g_free(channel);
+	}
+	if (elem == NULL) {
+		elem = snd_mixer_first_elem(handle);
+	}
+	assert(elem != NULL);
+
+	// Set callback, the state of a pooled element is still valid
+	if (pm && pm->elem == elem) {
+		DEBUG_PRINT("Using channel '%s'", snd_mixer_selem_get_name(elem));
+		estate = pm->estate;
+		snd_mixer_elem_set_callback(elem, alsa_cb);
+	} else {
+		bind_elem();
+	}
+	side_mixer_forget(pm);
+
+	// open the other members of the volume group, if any
+	build_group();
+
+	// set watch for volume changes
+	set_io_watch(handle);
+
+	return 0;
+}
+
+/**
+ * Deinitializes the alsa system by
+ * closing the mixer.
+ *
+ * @param disconnected whether the card went away or its handle got an
+ * i/o error, in which case the mixer is closed rather than pooled
+ */
+static void
+alsaunset(gboolean disconnected)
+{
+	gint pool_size;
+
+	if (active_card == NULL)
+		return;
+
+	unset_io_watch();
+	cancel_external_flush();
+	cancel_ramp();
+	clear_group();
+
+	// With a mixer pool, keep the handle open for a quick return
+	pool_size = settings.mixer_pool_size;
+	if (pool_size > 0 && !disconnected) {
+		pool_active_mixer(pool_size);
+		handle = NULL;
+		elem = NULL;
+		active_card = NULL;
+		return;
+	}
+
+	// 'elem' must be set to NULL at last, because alsa_cb()
+	// is invoked when closing mixer, and elem is needed.
+	close_mixer(handle, active_card->dev);
+	handle = NULL;
+	elem = NULL;
+	active_card = NULL;
+}
+
+/**
+ * Computes the raw volume value to write in order to reach a volume.
+ * The hardware may have only a few raw steps, so if the volume
+ * requested is not enough to reach the next step in the requested
+ * direction, that next step is returned. The current raw value is
+ * returned if it's already at the volume requested without a
+ * direction, so that such a write can be skipped.
+ *
+ * @param st the cached state of the element
+ * @param vol the volume in the 0-100 range
+ * @param dir select direction (-1 = accurate or first bellow, 0 = accurate,
+ * 1 = accurate or first above)
+ * @param normalize whether vol is a normalized volume
+ * @return the raw volume value
+ */
+static long
+vol_to_raw(const struct elem_state *st, int vol, int dir,
+	   gboolean normalize)
+{
+	long value;
+
+	if (dir == 0 &&
+	    vol == (st->has_dB && normalize ? st->norm_volume : st->volume))
+		return st->raw;
+
+	if (st->has_dB && normalize)
+		value = curve_norm_to_raw(st, vol, dir);
+	else
+		value = lrint_dir(0.01 * vol * (st->pmax - st->pmin), dir)
+			+ st->pmin;
+
+	value = CLAMP(value, st->pmin, st->pmax);
+
+	if (dir > 0 && value <= st->raw && st->raw < st->pmax)
+		value = st->raw + 1;
+	else if (dir < 0 && value >= st->raw && st->raw > st->pmin)
+		value = st->raw - 1;
+
+	return value;
+}
+
+/**
+ * Thread pool writing to the members of the volume group, so that
+ * a slow card doesn't delay the others.
+ */
+static GThreadPool *group_pool = NULL;
+
+/**
+ * Writes the pending values of a group member. This runs in a thread
+ * of group_pool, the writes of a given member are serialized by its
+ * lock, and only the latest pending values are written.
+ *
+ * @param data the group member
+ * @param user_data unused
+ */
+static void
+group_write_func(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+	struct side_mixer *sm = data;
+
+	g_mutex_lock(&sm->lock);
+	sm->queued = FALSE;
+
+	if (sm->pending_vol >= 0) {
+		long value = vol_to_raw(&sm->estate, sm->pending_vol, 0,
+					sm->pending_normalize);
+		if (!elem_state_is_raw(&sm->estate, value) &&
+		    snd_mixer_selem_set_playback_volume_all(sm->elem, value) >= 0)
+			set_elem_state_raw(&sm->estate, value);
+		sm->pending_vol = -1;
+	}
+
+	if (sm->pending_switch >= 0) {
+		if (sm->estate.has_playback_switch &&
+		    sm->pending_switch != sm->estate.playback_switch &&
+		    snd_mixer_selem_set_playback_switch_all(sm->elem,
+							    sm->pending_switch) >= 0)
+			sm->estate.playback_switch = sm->pending_switch;
+		sm->pending_switch = -1;
+	}
+
+	g_mutex_unlock(&sm->lock);
+}
+
+/**
+ * Queues a write of a group member, unless one is already queued.
+ * Must be called with the lock of the member held.
+ *
+ * @param sm the group member
+ */
+static void
+group_queue_write(struct side_mixer *sm)
+{
+	if (sm->queued)
+		return;
+
+	sm->queued = TRUE;
+	g_thread_pool_push(group_pool, sm, NULL);
+}
+
+/**
+ * Sets the volume of the group members, keeping their offsets
+ * relative to the volume of the card in use.
+ *
+ * @param vol the volume of the card in use
+ * @param normalize whether vol is a normalized volume
+ */
+static void
+group_set_volume(int vol, gboolean normalize)
+{
+	GSList *item;
+
+	for (item = group_members; item; item = item->next) {
+		struct side_mixer *sm = item->data;
+
+		g_mutex_lock(&sm->lock);
+		sm->pending_vol = CLAMP(vol + sm->offset, 0, 100);
+		sm->pending_normalize = normalize;
+		group_queue_write(sm);
+		g_mutex_unlock(&sm->lock);
+	}
+}
+
+/**
+ * Sets the playback switch of the group members.
+ *
+ * @param value the playback switch, 0 if muted
+ */
+static void
+group_set_switch(int value)
+{
+	GSList *item;
+
+	for (item = group_members; item; item = item->next) {
+		struct side_mixer *sm = item->data;
+
+		g_mutex_lock(&sm->lock);
+		sm->pending_switch = value;
+		group_queue_write(sm);
+		g_mutex_unlock(&sm->lock);
+	}
+}
+
+/**
+ * Computes the volume offsets of the group members, relative
+ * to the volume of the card in use, from the cached states.
+ */
+static void
+update_group_offsets(void)
+{
+	gboolean normalize = settings.normalize_volume;
+	int vol = getvol();
+	GSList *item;
+
+	for (item = group_members; item; item = item->next) {
+		struct side_mixer *sm = item->data;
+
+		g_mutex_lock(&sm->lock);
+		if (normalize)
+			sm->offset = sm->estate.norm_volume - vol;
+		else
+			sm->offset = sm->estate.volume - vol;
+		DEBUG_PRINT("Card %s: group member '%s', offset %d", sm->dev,
+			    snd_mixer_selem_get_name(sm->elem), sm->offset);
+		g_mutex_unlock(&sm->lock);
+	}
+}
+
+/**
+ * Opens a member of the volume group. The mixer is taken from
+ * the mixer pool if possible.
+ *
+ * @param card the card of the member
+ * @param channel the channel of the member
+ * @return the group member, or NULL if it can't be opened
+ */
+static struct side_mixer *
+open_group_member(struct acard *card, const char *channel)
+{
+	struct side_mixer *sm;
+	snd_mixer_selem_id_t *sid;
+	snd_mixer_elem_t *e;
+	snd_mixer_t *mixer;
+
+	sm = unpool_mixer(card->dev);
+	if (sm == NULL) {
+		mixer = open_card(card);
+		if (mixer == NULL)
+			return NULL;
+		sm = side_mixer_new(card->dev, mixer);
+	}
+
+	snd_mixer_selem_id_alloca(&sid);
+	snd_mixer_selem_id_set_name(sid, channel);
+	e = snd_mixer_find_selem(sm->handle, sid);
+	if (e == NULL) {
+		DEBUG_PRINT("Card %s: no channel '%s'", card->dev, channel);
+		side_mixer_free(sm);
+		return NULL;
+	}
+
+	// the state of a pooled element is still valid
+	if (e != sm->elem) {
+		sm->elem = e;
+		load_elem_caps(e, &sm->estate);
+		build_norm_curve(e, &sm->estate);
+		refresh_elem_state(e, &sm->estate);
+	}
+	set_side_watch(sm);
+
+	return sm;
+}
+
+/**
+ * Opens the members of the volume group selected by the VolumeGroup
+ * preference, besides the card and channel in use which always belong
+ * to the group. Members that are not available are skipped.
+ */
+static void
+build_group(void)
+{
+	gchar *group, **members, **m;
+
+	assert(group_members == NULL);
+
+	group = prefs_get_string("VolumeGroup", NULL);
+	if (group == NULL)
+		return;
+
+	members = prefs_get_group_members(group);
+	for (m = members; m && *m; m++) {
+		// card names may contain ':', channel names don't
+		gchar *sep = strrchr(*m, ':');
+		gchar *card_name;
+		struct acard *card;
+		struct side_mixer *sm;
+
+		if (sep == NULL) {
+			report_error(_("Invalid member of volume group %s: %s"),
+				     group, *m);
+			continue;
+		}
+
+		card_name = g_strndup(*m, sep - *m);
+		card = find_card(card_name);
+		g_free(card_name);
+
+		if (card == NULL) {
+			DEBUG_PRINT("Group %s: '%s' is not available", group, *m);
+			continue;
+		}
+		if (card == active_card &&
+		    !strcmp(sep + 1, snd_mixer_selem_get_name(elem)))
+			continue;
+
+		sm = open_group_member(card, sep + 1);
+		if (sm == NULL) {
+			DEBUG_PRINT("Group %s: can't open '%s'", group, *m);
+			continue;
+		}
+		group_members = g_slist_append(group_members, sm);
+	}
+	g_strfreev(members);
+	g_free(group);
+
+	if (group_members == NULL)
+		return;
+
+	group_pool = g_thread_pool_new(group_write_func, NULL,
+				       g_slist_length(group_members), FALSE, NULL);
+	update_group_offsets();
+}
+
+/**
+ * Closes the members of the volume group, once the pending
+ * writes are done.
+ */
+static void
+clear_group(void)
+{
+	if (group_pool) {
+		g_thread_pool_free(group_pool, FALSE, TRUE);
+		group_pool = NULL;
+	}
+
+	g_slist_free_full(group_members, (GDestroyNotify) side_mixer_free);
+	group_members = NULL;
+}
+
+/**
+ * Writes a raw volume value to the element and updates the
+ * cached state, as well as the volume group.
+ *
+ * @param value the raw volume value
+ * @param normalize whether the volume group follows the
+ * normalized volume
+ * @return 0 on success otherwise negative error code
+ */
+static int
+write_raw(long value, gboolean normalize)
+{
+	int err;
+
+	err = snd_mixer_selem_set_playback_volume_all(elem, value);
+	if (err < 0)
+		return err;
+
+	set_elem_state_raw(&estate, value);
+	if (group_members)
+		group_set_volume(normalize ? estate.norm_volume : estate.volume,
+				 normalize);
+
+	return 0;
+}
+
+/**
+ * Adjusts the current volume and sends a notification (if enabled).
+ * The volume is written at most once, and not at all if the hardware
+ * value wouldn't change. The cached state is updated from the value
+ * written, without reading it back from alsa.
+ *
+ * @param vol new volume value
+ * @param dir select direction (-1 = accurate or first bellow, 0 = accurate,
+ * 1 = accurate or first above)
+ * @param notify where the change comes from, see enum noti_source,
+ * NOTI_SOURCE_NONE not to send a notification
+ * @return 0 on success otherwise negative error code
+ */
+int
+setvol(int vol, int dir, gint notify)
+{
+	long value;
+	int err, cur_perc = getvol();
+	gboolean normalize = settings.normalize_volume;
+
+	// the user takes over from a ramp in progress
+	cancel_ramp();
+
+	value = vol_to_raw(&estate, vol, dir, normalize);
+	if (elem_state_is_raw(&estate, value))
+		return 0;
+
+	err = write_raw(value, normalize);
+	if (err < 0)
+		return err;
+
+	if (enable_noti && notify && cur_perc != getvol())
+		do_notify_volume(getvol(), FALSE, notify);
+
+	return 0;
+}
+
+/**
+ * Mutes or unmutes playback and sends a notification (if enabled).
+ *
+ * @param notify where the change comes from, see enum noti_source,
+ * NOTI_SOURCE_NONE not to send a notification
+ */
+void
+setmute(gint notify)
+{
+	int value;
+
+	if (!estate.has_playback_switch)
+		return;
+
+	value = ismuted() ? 0 : 1;
+	if (snd_mixer_selem_set_playback_switch_all(elem, value) < 0)
+		return;
+
+	estate.playback_switch = value;
+	if (group_members)
+		group_set_switch(value);
+	if (enable_noti && notify)
+		do_notify_volume(getvol(), value ? FALSE : TRUE, notify);
+}
+
+/**
+ * Check whether sound is currently muted.
+ * This is a lookup in the cached element state.
+ *
+ * @return 0 if mixer is muted, 1 otherwise
+ */
+int
+ismuted(void)
+{
+	return estate.playback_switch;
+}
+
+/**
+ * Gets the current volume in the range from 0 - 100.
+ * This is a lookup in the cached element state.
+ *
+ * @return current volume
+ */
+int
+getvol(void)
+{
+	gboolean normalize = settings.normalize_volume;
+
+	if (normalize)
+		return estate.norm_volume;
+	else
+		return estate.volume;
+}
+
+/**
+ * Minimum delay (in ms) between two writes of a volume ramp.
+ */
+#define RAMP_MIN_INTERVAL 16
+
+static guint ramp_id = 0;
+static long ramp_from, ramp_to;
+static int ramp_from_norm, ramp_to_norm;
+static int ramp_vol, ramp_dir;
+static gboolean ramp_normalize;
+static gint64 ramp_start, ramp_duration;
+
+/**
+ * Computes the raw volume value a ramp should be at.
+ * In NormalizeVolume mode, the ramp is linear in the normalized
+ * volume and the raw values come from the volume curve, so that
+ * each value is a real hardware step.
+ *
+ * @param frac the progress of the ramp, from 0 to 1.0
+ * @return the raw volume value
+ */
+static long
+ramp_raw_at(double frac)
+{
+	long raw;
+	int norm;
+
+	if (!estate.has_dB || !ramp_normalize)
+		return ramp_from + lrint((ramp_to - ramp_from) * frac);
+
+	norm = lrint(ramp_from_norm + (ramp_to_norm - ramp_from_norm) * frac);
+	raw = curve_norm_to_raw(&estate, norm, ramp_dir);
+
+	// don't overshoot because of the rounding of the curve
+	if (ramp_from < ramp_to)
+		return CLAMP(raw, ramp_from, ramp_to);
+	return CLAMP(raw, ramp_to, ramp_from);
+}
+
+/**
+ * Moves the volume one step further along the ramp. This is attached
+ * via g_timeout_add() in rampvol(), and only runs while a ramp is
+ * in progress.
+ *
+ * @param data passed to the function,
+ * set when the source was created
+ * @return FALSE if the source should be removed,
+ * TRUE otherwise
+ */
+static gboolean
+ramp_step(G_GNUC_UNUSED gpointer data)
+{
+	gint64 elapsed = g_get_monotonic_time() - ramp_start;
+	gboolean done = elapsed >= ramp_duration;
+	long value;
+
+	value = done ? ramp_to : ramp_raw_at(elapsed / (double) ramp_duration);
+	// the UI follows at most at the ExternalRefreshRate
+	if (!elem_state_is_raw(&estate, value)) {
+		write_raw(value, ramp_normalize);
+		schedule_ui_flush();
+	}
 
-	// Set the channel
-	// We have to handle the fact that the channel name defined
-	// in PNMixer configuration is not necessarily valid.
-	// For example, this may happen when the default alsa soundcard
-	// is modified. The channel names of the new default card may
-	// not match the channel names of the previous default card.
-	assert(elem == NULL);
-	channel = prefs_get_channel(active_card->name);
-	if (channel) {
-		snd_mixer_selem_id_t *sid;
-		snd_mixer_selem_id_alloca(&sid);
-		snd_mixer_selem_id_set_name(sid, channel);
-		elem = snd_mixer_find_selem(handle, sid);
-		g_free(channel);
+	if (done) {
+		ramp_id = 0;
+		return FALSE;
 	}
-	if (elem == NULL) {
-		elem = snd_mixer_first_elem(handle);
+
+	return TRUE;
+}
+
+/**
+ * Stops the volume ramp in progress, if any. The volume stays
+ * where the ramp left it.
+ */
+static void
+cancel_ramp(void)
+{
+	if (ramp_id == 0)
+		return;
+
+	g_source_remove(ramp_id);
+	ramp_id = 0;
+}
+
+/**
+ * Moves the volume smoothly to a new value over RampDuration
+ * milliseconds, and sends a notification (if enabled) with the
+ * final volume. If a ramp is already in progress, it's retargeted
+ * from the current volume. Without RampDuration, this is the same
+ * as setvol().
+ *
+ * @param vol new volume value
+ * @param dir select direction (-1 = accurate or first bellow, 0 = accurate,
+ * 1 = accurate or first above)
+ * @param notify where the change comes from, see enum noti_source,
+ * NOTI_SOURCE_NONE not to send a notification
+ * @return 0 on success otherwise negative error code
+ */
+int
+rampvol(int vol, int dir, gint notify)
+{
+	gint duration, interval;
+	long value, steps;
+	int cur_perc;
+
+	duration = settings.ramp_duration;
+	if (duration <= 0)
+		return setvol(vol, dir, notify);
+
+	cur_perc = getrampvol();
+	ramp_normalize = settings.normalize_volume;
+	value = vol_to_raw(&estate, vol, dir, ramp_normalize);
+
+	cancel_ramp();
+	// nothing to ramp, but the channels may still need to be
+	// brought to the same value, setvol() skips the write otherwise
+	if (value == estate.raw)
+		return setvol(vol, dir, notify);
+
+	ramp_from = estate.raw;
+	ramp_to = value;
+	ramp_dir = dir;
+	if (estate.has_dB) {
+		ramp_from_norm = curve_raw_to_norm(&estate, ramp_from);
+		ramp_to_norm = curve_raw_to_norm(&estate, ramp_to);
 	}
-	assert(elem != NULL);
+	// the volume the hardware will really be at, as getvol() will
+	// read it, so that relative changes during the ramp add up
+	if (estate.has_dB && ramp_normalize)
+		ramp_vol = ramp_to_norm;
+	else
+		ramp_vol = convert_prange(ramp_to, estate.pmin, estate.pmax);
+	ramp_start = g_get_monotonic_time();
+	ramp_duration = (gint64) duration * 1000;
 
-	// Set callback
-	DEBUG_PRINT("Using channel '%s'", snd_mixer_selem_get_name(elem));
-	snd_mixer_elem_set_callback(elem, alsa_cb);
+	// no need to wake up more often than there are hardware steps
+	steps = labs(ramp_to - ramp_from);
+	interval = CLAMP(duration / steps, RAMP_MIN_INTERVAL, duration);
+	ramp_id = g_timeout_add(interval, ramp_step, NULL);
 
-	// set watch for volume changes
-	set_io_watch(handle);
+	if (enable_noti && notify && cur_perc != ramp_vol)
+		do_notify_volume(ramp_vol, FALSE, notify);
 
 	return 0;
 }
 
 /**
- * Deinitializes the alsa system by
- * closing the mixer.
+ * Gets the volume the ramp in progress is heading to, in the range
+ * from 0 - 100. This is what relative volume changes should start
+ * from, so that repeated key presses add up during a ramp.
+ *
+ * @return the target volume of the ramp, or the current volume
+ * if there's no ramp in progress
+ */
+int
+getrampvol(void)
+{
+	if (ramp_id)
+		return ramp_vol;
+
+	return getvol();
+}
+
+static guint rebind_id = 0;
+
+/**
+ * Whether the pending idle_rebind() follows an i/o error
+ * on the mixer in use.
+ */
+static gboolean rebind_disconnected = FALSE;
+
+/**
+ * Closes the mixer in use and opens the selected card again (or the
+ * first card available) from the card list, without enumerating
+ * the cards. Then updates the states.
+ *
+ * @param disconnected whether the mixer in use got an i/o error,
+ * so that it's closed rather than pooled, see alsaunset()
  */
 static void
-alsaunset(void)
+rebind_active_card(gboolean disconnected)
 {
-	if (active_card == NULL)
-		return;
+	if (rebind_id) {
+		g_source_remove(rebind_id);
+		rebind_id = 0;
+		disconnected |= rebind_disconnected;
+	}
+	rebind_disconnected = FALSE;
 
-	unset_io_watch();
+	alsaunset(disconnected);
+	alsaset();
+	get_current_levels();
+	on_volume_has_changed();
+}
 
-	// 'elem' must be set to NULL at last, because alsa_cb()
-	// is invoked when closing mixer, and elem is needed.
-	close_mixer(handle, active_card->dev);
-	handle = NULL;
-	elem = NULL;
-	active_card = NULL;
+/**
+ * Switches to the card set in the preferences (or the first card
+ * available), reusing the card list instead of enumerating
+ * the cards again.
+ */
+void
+alsa_rebind(void)
+{
+	rebind_active_card(FALSE);
 }
 
 /**
- * Get the normalized current volume.
+ * We need to rebind the mixer in an idle moment, it doesn't seem
+ * very safe to do that while handling data in poll_cb().
+ * This function is attached via g_idle_add() in schedule_rebind().
  *
- * @param elem current mixer element
- * @param channel current channel
- * @return normalized volume
+ * @param data passed to the function,
+ * set when the source was created
+ * @return FALSE if the source should be removed,
+ * TRUE otherwise
  */
-static double
-get_normalized_volume(snd_mixer_elem_t *elem,
-		      snd_mixer_selem_channel_id_t channel)
+static gboolean
+idle_rebind(G_GNUC_UNUSED gpointer data)
 {
-	long min, max, value;
-	double normalized, min_norm;
-	int err;
+	rebind_id = 0;
+	rebind_active_card(rebind_disconnected);
+	return FALSE;
+}
+
+/**
+ * Schedules idle_rebind(), unless it's already pending.
+ *
+ * @param disconnected whether the mixer in use got an i/o error
+ */
+static void
+schedule_rebind(gboolean disconnected)
+{
+	rebind_disconnected |= disconnected;
+	if (rebind_id == 0)
+		rebind_id = g_idle_add(idle_rebind, NULL);
+}
 
-	err = snd_mixer_selem_get_playback_dB_range(elem, &min, &max);
-	if (err < 0 || min >= max) {
-		err = snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
-		if (err < 0 || min == max)
-			return 0;
+/**
+ * Watch on the /dev/snd directory, to notice cards appearing
+ * and disappearing.
+ */
+static GFileMonitor *snd_monitor = NULL;
 
-		err = snd_mixer_selem_get_playback_volume(elem, channel, &value);
-		if (err < 0)
-			return 0;
+/**
+ * Get the card of the card list with the given HCTL device name.
+ *
+ * @param dev the HCTL device name, like 'hw:0'
+ * @return the card or NULL if it's not in the list
+ */
+static struct acard *
+find_card_by_dev(const char *dev)
+{
+	GSList *item;
 
-		return (value - min) / (double) (max - min);
+	for (item = cards; item; item = item->next) {
+		struct acard *c = item->data;
+		if (!strcmp(c->dev, dev))
+			return c;
 	}
 
-	err = snd_mixer_selem_get_playback_dB(elem, channel, &value);
-	if (err < 0)
-		return 0;
+	return NULL;
+}
 
-	if (use_linear_dB_scale(min, max))
-		return (value - min) / (double) (max - min);
+/**
+ * Forgets the channels of the 'default' card. The default card
+ * usually points to another card, so its channels may change
+ * whenever a card appears or disappears.
+ */
+static void
+invalidate_default_card(void)
+{
+	struct acard *c = find_card_by_dev("default");
 
-	normalized = exp10((value - max) / 6000.0);
-	if (min != SND_CTL_TLV_DB_GAIN_MUTE) {
-		min_norm = exp10((min - max) / 6000.0);
-		normalized = (normalized - min_norm) / (1 - min_norm);
-	}
+	if (c == NULL || c == active_card)
+		return;
 
-	return normalized;
+	g_slist_free_full(c->channels, g_free);
+	c->channels = NULL;
+	c->channels_loaded = FALSE;
 }
 
 /**
- * Converts the current volume in the real volume range
- * reported by snd_mixer_selem_get_playback_volume_range()
- * into the 0-100 range.
+ * A card appeared, probes it and adds it to the card list. If it's
+ * the card selected in the preferences, and it's not in use yet,
+ * switches to it.
  *
- * @param val current volume value
- * @param min current minimum volume
- * @param max current maximum volume
- * @return volume converted into 0-100 range
+ * @param num the card number
  */
-static int
-convert_prange(long val, long min, long max)
+static void
+card_added(int num)
 {
-	long range = max - min;
-	if (range == 0)
-		return 0;
-	val -= min;
-	return rint(val / (double) range * 100);
+	snd_ctl_card_info_t *info;
+	snd_ctl_t *ctl;
+	struct acard *card;
+	gchar *card_name;
+	char buf[10];
+	int err;
+
+	sprintf(buf, "hw:%d", num);
+	if (find_card_by_dev(buf))
+		return;
+
+	/* The device may not be accessible yet, in which case
+	 * we'll try again on the next attribute change.
+	 */
+	snd_ctl_card_info_alloca(&info);
+	if (snd_ctl_open(&ctl, buf, 0) < 0)
+		return;
+	err = snd_ctl_card_info(ctl, info);
+	snd_ctl_close(ctl);
+	if (err < 0)
+		return;
+
+	card = card_new(snd_ctl_card_info_get_name(info), buf);
+	cards = g_slist_append(cards, card);
+	DEBUG_PRINT("Card '%s' (%s) appeared", card->dev, card->name);
+
+	invalidate_default_card();
+	g_free(cards_fingerprint);
+	cards_fingerprint = get_cards_fingerprint();
+	save_cards_cache();
+
+	card_name = prefs_get_string("AlsaCard", NULL);
+	if (card_name && active_card && !strcmp(card->name, card_name) &&
+	    strcmp(active_card->name, card_name))
+		rebind_active_card(FALSE);
+	g_free(card_name);
 }
 
 /**
- * Adjusts the current volume and sends a notification (if enabled).
+ * A card disappeared, removes it from the card list. If it's
+ * the card in use, opens another one.
  *
- * @param vol new volume value
- * @param dir select direction (-1 = accurate or first bellow, 0 = accurate,
- * 1 = accurate or first above)
- * @param notify whether to send notification
- * @return 0 on success otherwise negative error code
+ * @param num the card number
  */
-int
-setvol(int vol, int dir, gboolean notify)
+static void
+card_removed(int num)
 {
-	long min = 0, max = 0, value;
-	int cur_perc = getvol();
-	double dvol = 0.01 * vol;
-	gboolean normalize = prefs_get_boolean("NormalizeVolume", FALSE);
+	struct acard *card;
+	gboolean was_active;
+	char buf[10];
 
-	int err = snd_mixer_selem_get_playback_dB_range(elem, &min, &max);
-	if (err < 0 || min >= max || !normalize) {
-		err = snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
-		value = lrint_dir(dvol * (max - min), dir) + min;
-		snd_mixer_selem_set_playback_volume_all(elem, value);
-		if (enable_noti && notify && cur_perc != getvol())
-			do_notify_volume(getvol(), FALSE);
-		// intentionally set twice
-		return snd_mixer_selem_set_playback_volume_all(elem, value);
-	}
+	sprintf(buf, "hw:%d", num);
+	card = find_card_by_dev(buf);
+	if (card == NULL)
+		return;
 
-	if (use_linear_dB_scale(min, max)) {
-		value = lrint_dir(dvol * (max - min), dir) + min;
-		return snd_mixer_selem_set_playback_dB_all(elem, value, dir);
-	}
+	DEBUG_PRINT("Card '%s' (%s) disappeared", card->dev, card->name);
 
-	if (min != SND_CTL_TLV_DB_GAIN_MUTE) {
-		double min_norm = exp10((min - max) / 6000.0);
-		dvol = dvol * (1 - min_norm) + min_norm;
-	}
+	was_active = card == active_card;
+	if (was_active)
+		alsaunset(TRUE);
 
-	value = lrint_dir(6000.0 * log10(dvol), dir) + max;
-	snd_mixer_selem_set_playback_dB_all(elem, value, dir);
-	if (enable_noti && notify && cur_perc != getvol())
-		do_notify_volume(getvol(), FALSE);
-	// intentionally set twice
-	return snd_mixer_selem_set_playback_dB_all(elem, value, dir);
+	// a card not in use may still have its mixer in the pool
+	drop_pooled_mixer(card->dev);
+	cards = g_slist_remove(cards, card);
+	card_free(card);
+
+	if (was_active)
+		rebind_active_card(FALSE);
+
+	invalidate_default_card();
+	g_free(cards_fingerprint);
+	cards_fingerprint = get_cards_fingerprint();
+	save_cards_cache();
 }
 
 /**
- * Mutes or unmutes playback and sends a notification (if enabled).
+ * Handler for the signal 'changed' on the GFileMonitor snd_monitor.
+ * Cards have a control device named 'controlC<num>' in /dev/snd,
+ * we only care about these ones.
  *
- * @param notify whether to send notification
+ * @param monitor the monitor which received the signal
+ * @param file the file that changed
+ * @param other_file unused
+ * @param event_type the type of event
+ * @param data user data set when the signal handler was connected
  */
-void
-setmute(gboolean notify)
+static void
+on_snd_dir_changed(G_GNUC_UNUSED GFileMonitor *monitor, GFile *file,
+		   G_GNUC_UNUSED GFile *other_file, GFileMonitorEvent event_type,
+		   G_GNUC_UNUSED gpointer data)
 {
-	if (!snd_mixer_selem_has_playback_switch(elem))
+	gchar *basename;
+	int num;
+
+	basename = g_file_get_basename(file);
+	if (sscanf(basename, "controlC%d", &num) != 1) {
+		g_free(basename);
 		return;
-	if (ismuted()) {
-		snd_mixer_selem_set_playback_switch_all(elem, 0);
-		if (enable_noti && notify)
-			do_notify_volume(getvol(), TRUE);
-	} else {
-		snd_mixer_selem_set_playback_switch_all(elem, 1);
-		if (enable_noti && notify)
-			do_notify_volume(getvol(), FALSE);
+	}
+	g_free(basename);
+
+	switch (event_type) {
+	case G_FILE_MONITOR_EVENT_CREATED:
+	case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+		card_added(num);
+		break;
+	case G_FILE_MONITOR_EVENT_DELETED:
+		card_removed(num);
+		break;
+	default:
+		break;
 	}
 }
 
 /**
- * Check whether sound is currently muted.
- *
- * @return 0 if mixer is muted, 1 otherwise
+ * Starts watching /dev/snd for cards appearing and disappearing,
+ * unless it's already done.
  */
-int
-ismuted(void)
+static void
+start_device_watch(void)
 {
-	int muted = 1;
-	if (snd_mixer_selem_has_playback_switch(elem))
-		snd_mixer_selem_get_playback_switch(elem,
-						    SND_MIXER_SCHN_FRONT_LEFT, &muted);
-	return muted;
+	GFile *dir;
+	GError *err = NULL;
+
+	if (snd_monitor)
+		return;
+
+	dir = g_file_new_for_path("/dev/snd");
+	snd_monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_NONE,
+					       NULL, &err);
+	g_object_unref(dir);
+
+	if (snd_monitor == NULL) {
+		DEBUG_PRINT("Can't watch /dev/snd: %s", err->message);
+		g_error_free(err);
+		return;
+	}
+
+	g_signal_connect(snd_monitor, "changed",
+			 G_CALLBACK(on_snd_dir_changed), NULL);
 }
 
 /**
- * Gets the current volume in the range from 0 - 100.
+ * Switches to another channel of the active card. The mixer
+ * handle and its io watches are kept, only 'elem' and its
+ * callback are moved over to the new element.
  *
- * @return current volume
+ * @param channel the name of the channel to use
+ * @return TRUE on success, FALSE if there's no active card or
+ * the channel can't be found on it
  */
-int
-getvol(void)
+gboolean
+alsa_set_channel(const char *channel)
 {
-	gboolean normalize = prefs_get_boolean("NormalizeVolume", FALSE);
+	snd_mixer_selem_id_t *sid;
+	snd_mixer_elem_t *new_elem;
 
-	if (normalize) {
-		return lrint(get_normalized_volume(
-				     elem, SND_MIXER_SCHN_FRONT_RIGHT) * 100);
-	} else {
-		long val, pmin = 0, pmax = 0;
-		snd_mixer_selem_get_playback_volume_range(elem, &pmin, &pmax);
-		snd_mixer_selem_get_playback_volume(elem,
-						    SND_MIXER_SCHN_FRONT_RIGHT, &val);
-		DEBUG_PRINT("[getvol] From mixer: %li  pmin: %li  pmax: %li",
-			    val, pmin, pmax);
-		return convert_prange(val, pmin, pmax);
-	}
+	if (handle == NULL || channel == NULL)
+		return FALSE;
+
+	snd_mixer_selem_id_alloca(&sid);
+	snd_mixer_selem_id_set_name(sid, channel);
+	new_elem = snd_mixer_find_selem(handle, sid);
+	if (new_elem == NULL)
+		return FALSE;
+	if (new_elem == elem)
+		return TRUE;
+
+	// a pending flush or ramp belongs to the old element
+	cancel_external_flush();
+	cancel_ramp();
+	snd_mixer_elem_set_callback(elem, NULL);
+	elem = new_elem;
+	bind_elem();
+
+	// offsets are relative to the element in use, and it may
+	// be a member of the group itself
+	clear_group();
+	build_group();
+
+	return TRUE;
+}
+
+/**
+ * Builds the volume group again from the preferences, without
+ * rebinding the mixer. Does nothing if no card is open.
+ */
+void
+alsa_rebuild_group(void)
+{
+	if (handle == NULL)
+		return;
+
+	clear_group();
+	build_group();
 }
 
 /**
- * Initializes the alsa system. Deinitializes first
+ * Initializes the alsa system by getting the cards
+ * and opening the selected one. Deinitializes first
  * if we want to re-initialize.
  */
 void
 alsa_init(void)
 {
 	if (active_card)	// re-init, need to close down first
-		alsaunset();
+		alsaunset(FALSE);
+
+	// update list of available cards, channels are enumerated lazily
+	DEBUG_PRINT("Getting available cards...");
+	get_cards();
+
 	alsaset();
+	start_device_watch();
 }
 
 /**
- * Closes the alsa mixer handle.
+ * Closes the alsa mixer handle and the pooled mixers, and stops
+ * watching devices.
  */
 void
 alsa_close(void)
 {
+	if (snd_monitor) {
+		g_file_monitor_cancel(snd_monitor);
+		g_object_unref(snd_monitor);
+		snd_monitor = NULL;
+	}
+	clear_group();
+	clear_mixer_pool();
+	flush_cards_cache();
 	snd_mixer_close(handle);
 }
 
+/**
+ * Get the cached levels of a card. They are known for the card
+ * in use, the cards whose mixer is in the mixer pool and the
+ * members of the volume group.
+ *
+ * @param name the name of the card
+ * @param vol where to store the volume, in the range from 0 - 100
+ * @param muted where to store the playback switch, 0 if muted
+ * @return TRUE if the levels are known, FALSE otherwise
+ */
+gboolean
+alsa_get_card_levels(const char *name, int *vol, int *muted)
+{
+	struct acard *card = find_card(name);
+	struct side_mixer *sm;
+
+	if (card == NULL)
+		return FALSE;
+
+	if (card == active_card) {
+		*vol = getvol();
+		*muted = ismuted();
+		return TRUE;
+	}
+
+	sm = find_pooled_mixer(card->dev);
+	if (sm == NULL)
+		sm = find_side_mixer(group_members, card->dev);
+	if (sm == NULL)
+		return FALSE;
+
+	g_mutex_lock(&sm->lock);
+	if (settings.normalize_volume)
+		*vol = sm->estate.norm_volume;
+	else
+		*vol = sm->estate.volume;
+	*muted = sm->estate.playback_switch;
+	g_mutex_unlock(&sm->lock);
+
+	return TRUE;
+}
+
 /**
  * Get the card in use.
  *
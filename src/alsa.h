@@ -33,9 +33,14 @@ struct acard {
 	 */
 	char *dev;
 	/**
-	 * All playable channels in a list.
+	 * All playable channels in a list. It is filled lazily,
+	 * use get_card_channels() to access it.
 	 */
 	GSList *channels;
+	/**
+	 * Whether the channels list has been filled yet.
+	 */
+	gboolean channels_loaded;
 };
 
 /**
@@ -45,12 +50,20 @@ struct acard {
 GSList *cards;
 
 struct acard *find_card(const gchar *card);
-int setvol(int vol, int dir, gboolean notify);
-void setmute(gboolean notify);
+GSList *get_card_channels(struct acard *card);
+int setvol(int vol, int dir, gint notify);
+int rampvol(int vol, int dir, gint notify);
+int getrampvol(void);
+void setmute(gint notify);
 int getvol(void);
 int ismuted(void);
 void alsa_init(void);
+gboolean alsa_set_channel(const char *channel);
+void alsa_rebuild_group(void);
+void alsa_rebind(void);
+void alsa_trim_mixer_pool(void);
 void alsa_close(void);
+gboolean alsa_get_card_levels(const char *name, int *vol, int *muted);
 struct acard *alsa_get_active_card(void);
 const char *alsa_get_active_channel(void);
 
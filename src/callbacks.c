@@ -28,6 +28,7 @@
 #include "main.h"
 #include "support.h"
 #include "prefs.h"
+#include "notify.h"
 
 int volume;
 extern int volume;
@@ -48,16 +49,83 @@ on_mute_clicked(G_GNUC_UNUSED GtkButton *button,
 		G_GNUC_UNUSED gpointer user_data)
 {
 
-	setmute(popup_noti);
+	setmute(NOTI_SOURCE_POPUP);
 	on_volume_has_changed();
 	return TRUE;
 }
 
+/**
+ * Volume value waiting to be written by slider_write_timeout(),
+ * -1 if there is none.
+ */
+static int slider_pending_vol = -1;
+static guint slider_write_id = 0;
+
+/**
+ * Writes a volume value coming from the vol_scale, unmutes if needed
+ * and updates the states.
+ *
+ * @param vol the new volume value
+ */
+static void
+slider_write(int vol)
+{
+	setvol(vol, 0, NOTI_SOURCE_POPUP);
+	if (ismuted() == 0)
+		setmute(NOTI_SOURCE_POPUP);
+
+	on_volume_has_changed();
+}
+
+/**
+ * Writes the last volume value received from the vol_scale, if any.
+ * This is attached via g_timeout_add() in vol_scroll_event(), and runs
+ * as long as the slider keeps moving.
+ *
+ * @param data passed to the function,
+ * set when the source was created
+ * @return FALSE if the source should be removed,
+ * TRUE otherwise
+ */
+static gboolean
+slider_write_timeout(G_GNUC_UNUSED gpointer data)
+{
+	if (slider_pending_vol < 0) {
+		slider_write_id = 0;
+		return FALSE;
+	}
+
+	slider_write(slider_pending_vol);
+	slider_pending_vol = -1;
+	return TRUE;
+}
+
+/**
+ * Drops the volume value waiting to be written by the vol_scale,
+ * if any. It was meant for the mixer element in use when it was
+ * received, so it must not be written after switching to another
+ * card or channel.
+ */
+void
+cancel_slider_write(void)
+{
+	if (slider_write_id) {
+		g_source_remove(slider_write_id);
+		slider_write_id = 0;
+	}
+	slider_pending_vol = -1;
+}
+
 /**
  * Callback function when the vol_scale (GtkScale) in the volume
  * popup window received the change-value signal
  * (either via mouse or keyboard).
  *
+ * The slider itself follows the input at full rate, but the
+ * hardware is written at most SliderWriteRate times per second.
+ * Values received in between are combined, the latest one wins
+ * and is always written at last.
+ *
  * @param range the GtkRange that received the signal
  * @param scroll the type of scroll action that was performed
  * @param value the new value resulting from the scroll action
@@ -90,11 +158,17 @@ vol_scroll_event(GtkRange *range,
 
 	volumeset = (int) value;
 
-	setvol(volumeset, 0, popup_noti);
-	if (ismuted() == 0)
-		setmute(popup_noti);
+	/* A write happened recently, wait for slider_write_timeout() */
+	if (slider_write_id) {
+		slider_pending_vol = volumeset;
+		return FALSE;
+	}
 
-	on_volume_has_changed();
+	slider_write(volumeset);
+
+	slider_pending_vol = -1;
+	slider_write_id = g_timeout_add(1000 / settings.slider_write_rate,
+					slider_write_timeout, NULL);
 
 	return FALSE;
 }
@@ -114,15 +188,15 @@ on_scroll(G_GNUC_UNUSED GtkStatusIcon *status_icon,
 		GdkEventScroll *event,
 		G_GNUC_UNUSED gpointer user_data)
 {
-	int cv = getvol();
+	int cv = getrampvol();
 	if (event->direction == GDK_SCROLL_UP) {
-		setvol(cv + scroll_step, 1, mouse_noti);
+		rampvol(cv + scroll_step, 1, NOTI_SOURCE_MOUSE);
 	} else if (event->direction == GDK_SCROLL_DOWN) {
-		setvol(cv - scroll_step, -1, mouse_noti);
+		rampvol(cv - scroll_step, -1, NOTI_SOURCE_MOUSE);
 	}
 
 	if (ismuted() == 0)
-		setmute(mouse_noti);
+		setmute(NOTI_SOURCE_MOUSE);
 
 	// this will set the slider value
 	get_current_levels();
@@ -185,7 +259,7 @@ gtk_combo_box_get_active_id(GtkComboBox *combo_box)
 void
 on_ok_button_clicked(G_GNUC_UNUSED GtkButton *button, PrefsData *data)
 {
-	gint alsa_change = 0;
+	gint alsa_change = ALSA_CHANGE_NONE;
 
 	// pull out various prefs
 
@@ -238,7 +312,7 @@ on_ok_button_clicked(G_GNUC_UNUSED GtkButton *button, PrefsData *data)
 	gchar *old_card = prefs_get_string("AlsaCard", NULL);
 	gchar *card = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(acc));
 	if (old_card && strcmp(old_card, card))
-		alsa_change = 1;
+		alsa_change = ALSA_CHANGE_CARD;
 	prefs_set_string("AlsaCard", card);
 
 	// channel
@@ -250,8 +324,8 @@ on_ok_button_clicked(G_GNUC_UNUSED GtkButton *button, PrefsData *data)
 	}
 	gchar *chan = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(ccc));
 	if (old_channel) {
-		if (strcmp(old_channel, chan))
-			alsa_change = 1;
+		if (strcmp(old_channel, chan) && alsa_change == ALSA_CHANGE_NONE)
+			alsa_change = ALSA_CHANGE_CHANNEL;
 		g_free(old_channel);
 	}
 	prefs_set_channel(card, chan);
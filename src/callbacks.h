@@ -27,6 +27,8 @@ gboolean on_mute_clicked(GtkButton *button, GdkEvent *event,
 gboolean vol_scroll_event(GtkRange *range,
 			  GtkScrollType scroll, gdouble value, gpointer user_data);
 
+void cancel_slider_write(void);
+
 void on_ok_button_clicked(GtkButton *button, PrefsData *data);
 
 void on_cancel_button_clicked(GtkButton *button, PrefsData *data);
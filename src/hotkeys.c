@@ -24,17 +24,71 @@
 #include "main.h"
 #include "prefs.h"
 #include "alsa.h"
+#include "notify.h"
+#include "callbacks.h"
+#include "hotkeys.h"
+#include "debug.h"
+#include <string.h>
 #include <gdk/gdkx.h>
 #include <X11/XKBlib.h>
 
 
-static int volMuteKey = -1;
-static int volDownKey = -1;
-static int volUpKey = -1;
-static int volMuteMods = -1;
-static int volDownMods = -1;
-static int volUpMods = -1;
-static int volStep = 1;
+/**
+ * Keycodes are in the range 8 - 255 in X.
+ */
+#define N_KEYCODES 256
+
+/**
+ * The modifiers that are part of a hotkey. The other ones, like
+ * numlock, capslock or mouse buttons, are ignored.
+ */
+#define HOTKEY_MODS_MASK (GDK_SHIFT_MASK | GDK_CONTROL_MASK | GDK_MOD1_MASK | \
+			  GDK_MOD3_MASK | GDK_MOD4_MASK | GDK_MOD5_MASK)
+
+/**
+ * A hotkey binding.
+ */
+struct hotkey {
+	/**
+	 * The X keycode.
+	 */
+	gint keycode;
+	/**
+	 * The modifiers, masked with HOTKEY_MODS_MASK.
+	 */
+	guint mods;
+	/**
+	 * What the hotkey does, see enum hotkey_action.
+	 */
+	gint action;
+	/**
+	 * The volume step of HOTKEY_VOLUME, negative to lower the volume.
+	 */
+	gint step;
+	/**
+	 * The accelerator name, to report grab errors.
+	 */
+	gchar *name;
+	/**
+	 * Serial of the first grab request, to report grab errors.
+	 */
+	unsigned long serial;
+	/**
+	 * The next binding with the same keycode.
+	 */
+	struct hotkey *next;
+};
+
+/**
+ * All the bindings.
+ */
+static GSList *hotkeys = NULL;
+
+/**
+ * The bindings, indexed by keycode, so that key_filter() only
+ * looks at the few bindings of the key that was pressed.
+ */
+static struct hotkey *hotkey_table[N_KEYCODES];
 
 // `xmodmap -pm`
 /**
@@ -49,28 +103,138 @@ static guint keymasks[] = {
 };
 
 /**
- * Checks if the keycode we got (minus modifiers like
- * numlock/capslock) matches the keycode we want.
- * Thus numlock + o will match o.
+ * Switches to the next card of the card list that has playable
+ * channels, wrapping around, and saves it as the card to use.
+ */
+static void
+cycle_card(void)
+{
+	struct acard *active = alsa_get_active_card();
+	GSList *start = active ? g_slist_find(cards, active) : NULL;
+	GSList *item = start;
+	struct acard *card = NULL;
+	guint n = g_slist_length(cards);
+	gchar *name;
+
+	while (card == NULL && n--) {
+		item = item && item->next ? item->next : cards;
+		if (item == start)
+			return;
+		if (get_card_channels(item->data))
+			card = item->data;
+	}
+	if (card == NULL)
+		return;
+
+	// the card list doesn't survive the rebind if cards
+	// appeared or disappeared in the meantime
+	name = g_strdup(card->name);
+
+	DEBUG_PRINT("Switching to card '%s'", name);
+	prefs_set_string("AlsaCard", name);
+	prefs_save();
+	cancel_slider_write();
+	alsa_rebind();
+
+	if (enable_noti && hotkey_noti)
+		do_notify_text(_("Soundcard"), name);
+	g_free(name);
+}
+
+/**
+ * Source id of the pending hotkey_paint() call, or 0.
+ */
+static guint paint_id = 0;
+
+/**
+ * Whether a hotkey changed the volume or mute state since
+ * the last hotkey_paint() call.
+ */
+static gboolean paint_notify = FALSE;
+
+/**
+ * Updates the UI and sends a notification after hotkeys changed
+ * the volume. Running this from the main loop once the key events
+ * are handled keeps it out of the key-to-sound latency, and a burst
+ * of key presses results in a single update.
+ * This function is attached via g_idle_add() in schedule_paint().
  *
- * @param got the key we got
- * @param want the key we want
- * @return TRUE if there is a match,
- * FALSE otherwise
+ * @param data unused
+ * @return FALSE, so the source is removed
  */
 static gboolean
-checkModKey(int got, int want)
+hotkey_paint(G_GNUC_UNUSED gpointer data)
 {
-	guint i;
-	for (i = 0; i < G_N_ELEMENTS(keymasks); i++)
-		if ((int) (want | keymasks[i]) == got)
-			return TRUE;
+	paint_id = 0;
+
+	on_volume_has_changed();
+
+	// this will set the slider value
+	get_current_levels();
+
+	if (paint_notify && enable_noti)
+		do_notify_volume(getrampvol(), ismuted() ? FALSE : TRUE,
+				 NOTI_SOURCE_HOTKEY);
+	paint_notify = FALSE;
+
 	return FALSE;
 }
 
+/**
+ * Schedules hotkey_paint(), unless it's already pending.
+ *
+ * @param changed whether the volume or mute state changed
+ */
+static void
+schedule_paint(gboolean changed)
+{
+	paint_notify |= changed;
+
+	if (paint_id == 0)
+		paint_id = g_idle_add(hotkey_paint, NULL);
+}
+
+/**
+ * Runs the action of a hotkey. The hardware is written right away,
+ * from the cached state, while the UI and notification are left
+ * to hotkey_paint().
+ *
+ * @param hk the hotkey
+ */
+static void
+run_hotkey(struct hotkey *hk)
+{
+	int cv, unmuted;
+
+	switch (hk->action) {
+	case HOTKEY_MUTE:
+		setmute(NOTI_SOURCE_NONE);
+		schedule_paint(TRUE);
+		break;
+	case HOTKEY_VOLUME:
+		cv = getrampvol();
+		unmuted = ismuted();
+		rampvol(cv + hk->step, hk->step > 0 ? 1 : -1,
+			NOTI_SOURCE_NONE);
+
+		if (ismuted() == 0)
+			setmute(NOTI_SOURCE_NONE);
+
+		schedule_paint(cv != getrampvol() || unmuted != ismuted());
+		break;
+	case HOTKEY_NEXT_CARD:
+		cycle_card();
+		break;
+	default:
+		break;
+	}
+}
+
 /**
  * This function is called before gdk/gtk can respond
  * to any(!) window event and handles pressed hotkeys.
+ * The bindings are looked up by keycode, with the ignored
+ * modifiers like numlock/capslock masked out once.
  *
  * @param gdk_xevent the native event to filter
  * @param event the GDK event to which the X event will be translated
@@ -82,40 +246,22 @@ key_filter(GdkXEvent *gdk_xevent,
 		G_GNUC_UNUSED GdkEvent *event,
 		G_GNUC_UNUSED gpointer data)
 {
-	int type;
-	guint key, state;
-	XKeyEvent *xevent;
-	//gboolean bResult;
-
-	xevent = gdk_xevent;
-	type = xevent->type;
-
-	if (type == KeyPress) {
-		key = ((XKeyEvent *) xevent)->keycode;
-		state = ((XKeyEvent *) xevent)->state;
-
-		if ((int) key == volMuteKey && checkModKey(state, volMuteMods)) {
-			setmute(enable_noti && hotkey_noti);
-			on_volume_has_changed();
-			return GDK_FILTER_CONTINUE;
-		} else {
-			int cv = getvol();
-			if ((int) key == volUpKey && checkModKey(state, volUpMods)) {
-				setvol(cv + volStep, 1, enable_noti && hotkey_noti);
-			} else if ((int) key == volDownKey && checkModKey(state, volDownMods)) {
-				setvol(cv - volStep, -1, enable_noti && hotkey_noti);
-			}
-			// just ignore unknown hotkeys
-
-			if (ismuted() == 0)
-				setmute(enable_noti && hotkey_noti);
-
-			on_volume_has_changed();
-
-			// this will set the slider value
-			get_current_levels();
+	XKeyEvent *xevent = gdk_xevent;
+	struct hotkey *hk;
+	guint mods;
+
+	if (xevent->type != KeyPress || xevent->keycode >= N_KEYCODES ||
+	    (hk = hotkey_table[xevent->keycode]) == NULL)
+		return GDK_FILTER_CONTINUE;
+
+	mods = xevent->state & HOTKEY_MODS_MASK;
+	for (; hk; hk = hk->next) {
+		if (hk->mods == mods) {
+			run_hotkey(hk);
+			break;
 		}
 	}
+
 	return GDK_FILTER_CONTINUE;
 }
 
@@ -135,8 +281,6 @@ add_filter(void)
 static char xErr;
 int errBufSize = 512;
 char *errBuf, *printBuf;
-static unsigned long muteSerial, downSerial, upSerial;
-static gchar *muteSymStr = NULL, *downSymStr = NULL, *upSymStr = NULL;
 
 /**
  * When an Xlib error occurs, this function is called. It is
@@ -149,18 +293,23 @@ static gchar *muteSymStr = NULL, *downSymStr = NULL, *upSymStr = NULL;
 static int
 errhdl(G_GNUC_UNUSED Display *disp, XErrorEvent *ev)
 {
-	int p;
+	GSList *item;
+	int p = 0;
+
 	xErr = 1;
-	if (ev->serial == muteSerial)
-		p = snprintf(printBuf, errBufSize, " %s\n", muteSymStr);
-	else if (ev->serial == downSerial)
-		p = snprintf(printBuf, errBufSize, " %s\n", downSymStr);
-	else if (ev->serial == upSerial)
-		p = snprintf(printBuf, errBufSize, " %s\n", upSymStr);
-	else {
-		p = 0;
-		g_warning("Unknown serial in X error handler\n");
+	for (item = hotkeys; item; item = item->next) {
+		struct hotkey *hk = item->data;
+
+		// each hotkey is grabbed once per entry of keymasks
+		if (ev->serial >= hk->serial &&
+		    ev->serial < hk->serial + G_N_ELEMENTS(keymasks)) {
+			p = snprintf(printBuf, errBufSize, " %s\n", hk->name);
+			break;
+		}
 	}
+	if (item == NULL)
+		g_warning("Unknown serial in X error handler\n");
+
 	errBufSize -= p;
 	printBuf = printBuf + p;
 	return 0;
@@ -169,7 +318,7 @@ errhdl(G_GNUC_UNUSED Display *disp, XErrorEvent *ev)
 /**
  * We need to report error in idle moment
  * since we can't report_error before gtk_main is called.
- * This function is attached via g_idle_add() in grab_keys(),
+ * This function is attached via g_idle_add() in grab_hotkeys(),
  * whenever there is an Xerror.
  *
  * @param data passed to the function,
@@ -186,95 +335,126 @@ idle_report_error(G_GNUC_UNUSED gpointer data)
 }
 
 /**
- * Grabs keys on the Xserver level via XGrabKey(),
- * so they can be intercepted and interpreted by
- * our application, thus having global hotkeys.
+ * Frees a hotkey binding.
  *
- * If mk, uk and dk parameters are -1, then
- * this function will just ungrab everything.
- *
- * @param mk mutekey
- * @param uk volume up key
- * @param dk volume down key
- * @param mm volume mute mod key
- * @param um volume up mod key
- * @param dm volume down mod key
- * @param step hotkey volume step
+ * @param hk the binding
+ */
+static void
+hotkey_free(struct hotkey *hk)
+{
+	g_free(hk->name);
+	g_slice_free(struct hotkey, hk);
+}
+
+/**
+ * Ungrabs all the keys and removes all the bindings.
  */
 void
-grab_keys(int mk, int uk, int dk, int mm, int um, int dm, int step)
+unbind_hotkeys(void)
 {
-	Display *disp = gdk_x11_get_default_xdisplay();
+	XUngrabKey(gdk_x11_get_default_xdisplay(), AnyKey, AnyModifier,
+		   GDK_ROOT_WINDOW());
 
-	// ungrab any previous keys
-	XUngrabKey(disp, AnyKey, AnyModifier, GDK_ROOT_WINDOW());
+	g_slist_free_full(hotkeys, (GDestroyNotify) hotkey_free);
+	hotkeys = NULL;
+	memset(hotkey_table, 0, sizeof(hotkey_table));
+}
 
-	volMuteKey = mk;
-	volUpKey = uk;
-	volDownKey = dk;
-	volMuteMods = mm;
-	volUpMods = um;
-	volDownMods = dm;
-	volStep = step;
+/**
+ * The virtual modifiers that gtk_accelerator_parse() may return,
+ * which must be mapped to real modifiers before grabbing.
+ */
+#define VIRTUAL_MODS_MASK (GDK_SUPER_MASK | GDK_HYPER_MASK | GDK_META_MASK)
 
-	if (mk < 0 && uk < 0 && dk < 0)
+/**
+ * Adds a hotkey binding. It's not grabbed until grab_hotkeys()
+ * is called. Bindings with an invalid keycode are ignored.
+ * Virtual modifiers like Super are mapped to the real modifiers
+ * they are bound to, the binding is rejected if that's not possible,
+ * rather than grabbing the key without them.
+ *
+ * @param keycode the X keycode
+ * @param mods the modifiers
+ * @param action what the hotkey does, see enum hotkey_action
+ * @param step the volume step for HOTKEY_VOLUME,
+ * negative to lower the volume
+ */
+void
+bind_hotkey(gint keycode, guint mods, gint action, gint step)
+{
+	struct hotkey *hk;
+	guint virt;
+
+	if (keycode <= 0 || keycode >= N_KEYCODES)
 		return;
 
-	xErr = 0;
-	errBuf = g_malloc(errBufSize * sizeof(gchar));
-	printBuf =
-		errBuf + snprintf(errBuf, errBufSize,
-				  _("Could not bind the following hotkeys:\n"));
-	errBufSize -= (printBuf - errBuf);
+	// fold each virtual modifier into its real one, the real one may
+	// already be there too, as in Mod4 and Super for <Super>
+	for (virt = 1; virt; virt <<= 1) {
+		GdkModifierType real = virt;
 
-	if (muteSymStr)
-		g_free(muteSymStr);
-	if (upSymStr)
-		g_free(upSymStr);
-	if (downSymStr)
-		g_free(downSymStr);
+		if (!(mods & virt & VIRTUAL_MODS_MASK))
+			continue;
 
-	muteSymStr =
-		gtk_accelerator_name(
-			XkbKeycodeToKeysym(gdk_x11_get_default_xdisplay(),
-					   volMuteKey, 0, 0),
-			volMuteMods);
+		gdk_keymap_map_virtual_modifiers(gdk_keymap_get_default(),
+						 &real);
+		if (!(real & HOTKEY_MODS_MASK)) {
+			g_warning("Can't map the modifiers 0x%x of keycode %d, "
+				  "ignoring the hotkey", mods, keycode);
+			return;
+		}
+		mods = (mods & ~virt) | (real & HOTKEY_MODS_MASK);
+	}
 
-	upSymStr =
-		gtk_accelerator_name(
+	hk = g_slice_new0(struct hotkey);
+	hk->keycode = keycode;
+	hk->mods = mods & HOTKEY_MODS_MASK;
+	hk->action = action;
+	hk->step = step;
+	hk->name = gtk_accelerator_name(
 			XkbKeycodeToKeysym(gdk_x11_get_default_xdisplay(),
-					   volUpKey, 0, 0),
-			volUpMods);
+					   keycode, 0, 0),
+			hk->mods);
 
-	downSymStr =
-		gtk_accelerator_name(
-			XkbKeycodeToKeysym(gdk_x11_get_default_xdisplay(),
-					   volDownKey, 0, 0),
-			volDownMods);
+	hk->next = hotkey_table[keycode];
+	hotkey_table[keycode] = hk;
+	hotkeys = g_slist_prepend(hotkeys, hk);
+}
 
-	XErrorHandler old_hdlr = XSetErrorHandler(errhdl);
+/**
+ * Grabs the bound keys on the Xserver level via XGrabKey(),
+ * so they can be intercepted and interpreted by
+ * our application, thus having global hotkeys.
+ * Errors are reported in an idle moment.
+ */
+void
+grab_hotkeys(void)
+{
+	Display *disp = gdk_x11_get_default_xdisplay();
+	XErrorHandler old_hdlr;
+	GSList *item;
 	guint i;
-	for (i = 0; i < G_N_ELEMENTS(keymasks); i++) {
-		if (volMuteKey > 0) {
-			muteSerial = NextRequest(disp);
-			XGrabKey(disp, volMuteKey, volMuteMods | keymasks[i],
-				 GDK_ROOT_WINDOW(), 1,
-				 GrabModeAsync, GrabModeAsync);
-		}
 
-		if (volUpKey > 0) {
-			upSerial = NextRequest(disp);
-			XGrabKey(disp, volUpKey, volUpMods | keymasks[i],
-				 GDK_ROOT_WINDOW(), 1,
-				 GrabModeAsync, GrabModeAsync);
-		}
+	if (hotkeys == NULL)
+		return;
 
-		if (volDownKey > 0) {
-			downSerial = NextRequest(disp);
-			XGrabKey(disp, volDownKey, volDownMods | keymasks[i],
+	xErr = 0;
+	errBufSize = 512;
+	errBuf = g_malloc(errBufSize * sizeof(gchar));
+	printBuf =
+		errBuf + snprintf(errBuf, errBufSize,
+				  _("Could not bind the following hotkeys:\n"));
+	errBufSize -= (printBuf - errBuf);
+
+	old_hdlr = XSetErrorHandler(errhdl);
+	for (item = hotkeys; item; item = item->next) {
+		struct hotkey *hk = item->data;
+
+		hk->serial = NextRequest(disp);
+		for (i = 0; i < G_N_ELEMENTS(keymasks); i++)
+			XGrabKey(disp, hk->keycode, hk->mods | keymasks[i],
 				 GDK_ROOT_WINDOW(), 1,
 				 GrabModeAsync, GrabModeAsync);
-		}
 	}
 
 	XFlush(disp);
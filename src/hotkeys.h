@@ -17,7 +17,21 @@
 #ifndef HOTKEYS_H_
 #define HOTKEYS_H_
 
+#include <glib.h>
+
+/**
+ * What a hotkey does.
+ */
+enum hotkey_action {
+	HOTKEY_NONE,
+	HOTKEY_MUTE,		/**< toggle mute */
+	HOTKEY_VOLUME,		/**< change the volume by a step */
+	HOTKEY_NEXT_CARD,	/**< switch to the next card */
+};
+
 void add_filter(void);
-void grab_keys(int, int, int, int, int, int, int);
+void unbind_hotkeys(void);
+void bind_hotkey(gint keycode, guint mods, gint action, gint step);
+void grab_hotkeys(void);
 
 #endif				// HOTKEYS_H
@@ -36,6 +36,7 @@
 #include "callbacks.h"
 #include "main.h"
 #include "notify.h"
+#include "osd.h"
 #include "support.h"
 #include "hotkeys.h"
 #include "prefs.h"
@@ -200,16 +201,12 @@ void
 tray_icon_button(G_GNUC_UNUSED GtkStatusIcon *status_icon,
 		 GdkEventButton *event, G_GNUC_UNUSED gpointer user_data)
 {
-	gint action;
-
 	if (event->button != 2)
 		return;
-	
-	action = prefs_get_integer("MiddleClickAction", 0);
 
-	switch (action) {
+	switch (settings.middle_click_action) {
 	case 0:	// mute/unmute
-		setmute(mouse_noti);
+		setmute(NOTI_SOURCE_MOUSE);
 		on_volume_has_changed();
 		break;
 	case 1:
@@ -219,14 +216,9 @@ tray_icon_button(G_GNUC_UNUSED GtkStatusIcon *status_icon,
 		on_mixer();
 		break;
 	case 3: {
-		gchar *cmd;
-
-		cmd = prefs_get_string("CustomCommand", NULL);
-
-		if (cmd) {
-			run_command(cmd);
-			g_free(cmd);
-		} else
+		if (settings.custom_command)
+			run_command(settings.custom_command);
+		else
 			report_error(_("You have not specified a custom command to run, "
 			               "please specify one in preferences."));
 		break;
@@ -319,8 +311,94 @@ tray_icon_resized(G_GNUC_UNUSED GtkStatusIcon *status_icon,
 }
 
 /**
- * Creates the tray icon and connects the signals 'scroll_event'
- * and 'size-changed'.
+ * Whether the tooltip of the tray_icon was shown since the pointer
+ * last left the icon, see tray_tooltip_visible().
+ */
+static gboolean tray_tooltip_shown = FALSE;
+
+/**
+ * Handles the 'query-tooltip' signal on the tray_icon, by
+ * building the tooltip from the current state.
+ *
+ * @param status_icon the object which received the signal
+ * @param x the x coordinate of the cursor position
+ * @param y the y coordinate of the cursor position
+ * @param keyboard_mode TRUE if the tooltip was triggered using the keyboard
+ * @param tooltip a GtkTooltip
+ * @param user_data set when the signal handler was connected
+ * @return TRUE if the tooltip should be shown
+ */
+static gboolean
+tray_icon_query_tooltip(G_GNUC_UNUSED GtkStatusIcon *status_icon,
+			G_GNUC_UNUSED gint x, G_GNUC_UNUSED gint y,
+			G_GNUC_UNUSED gboolean keyboard_mode,
+			GtkTooltip *tooltip, G_GNUC_UNUSED gpointer user_data)
+{
+	struct acard *card = alsa_get_active_card();
+	gchar *text;
+
+	if (card == NULL)
+		return FALSE;
+
+	if (ismuted() == 1)
+		text = g_strdup_printf(_("%s (%s)\nVolume: %d %%"), card->name,
+				       alsa_get_active_channel(), getvol());
+	else
+		text = g_strdup_printf(_("%s (%s)\nVolume: %d %%\nMuted"),
+				       card->name, alsa_get_active_channel(),
+				       getvol());
+	gtk_tooltip_set_text(tooltip, text);
+	g_free(text);
+
+	tray_tooltip_shown = TRUE;
+	return TRUE;
+}
+
+/**
+ * Checks whether the tooltip of the tray_icon may be visible, that is
+ * if it was shown and the pointer is still over the icon. Gtk+ doesn't
+ * tell when a tooltip is hidden, but it's hidden when the pointer
+ * leaves the widget it belongs to.
+ *
+ * @return TRUE if the tooltip may be visible
+ */
+static gboolean
+tray_tooltip_visible(void)
+{
+	GdkDisplay *display = gdk_display_get_default();
+	GdkScreen *screen, *pointer_screen;
+	GdkRectangle area;
+	gint x, y;
+
+	if (!tray_tooltip_shown)
+		return FALSE;
+
+	if (!gtk_status_icon_get_geometry(tray_icon, &screen, &area, NULL)) {
+		tray_tooltip_shown = FALSE;
+		return FALSE;
+	}
+
+#ifdef WITH_GTK3
+	gdk_device_get_position(gdk_device_manager_get_client_pointer
+				(gdk_display_get_device_manager(display)),
+				&pointer_screen, &x, &y);
+#else
+	gdk_display_get_pointer(display, &pointer_screen, &x, &y, NULL);
+#endif
+
+	if (pointer_screen != screen ||
+	    x < area.x || x >= area.x + area.width ||
+	    y < area.y || y >= area.y + area.height) {
+		tray_tooltip_shown = FALSE;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Creates the tray icon and connects the signals 'scroll_event',
+ * 'size-changed' and 'query-tooltip'.
  *
  * @return the newly created tray icon
  */
@@ -329,6 +407,11 @@ create_tray_icon(void)
 {
 	tray_icon = gtk_status_icon_new();
 
+	/* the tooltip is built on demand */
+	gtk_status_icon_set_has_tooltip(tray_icon, TRUE);
+	g_signal_connect((gpointer) tray_icon, "query-tooltip",
+			 G_CALLBACK(tray_icon_query_tooltip), NULL);
+
 	/* catch scroll-wheel events */
 	g_signal_connect((gpointer) tray_icon, "scroll_event",
 			 G_CALLBACK(on_scroll), NULL);
@@ -467,12 +550,58 @@ do_prefs(void)
 void
 do_alsa_reinit(void)
 {
+	cancel_slider_write();
 	alsa_init();
 	update_status_icons();
 	update_vol_text();
 	on_volume_has_changed();
 }
 
+/**
+ * Switches to the card set in the preferences, reusing the card
+ * list instead of reinitializing alsa, and updates the various states.
+ */
+void
+do_alsa_card_change(void)
+{
+	cancel_slider_write();
+	alsa_rebind();
+	update_status_icons();
+	update_vol_text();
+}
+
+/**
+ * Switches to the channel set in the preferences without
+ * reopening the mixer, as long as the card in use is the
+ * configured one. Falls back to do_alsa_reinit() otherwise.
+ */
+void
+do_alsa_channel_change(void)
+{
+	struct acard *card = alsa_get_active_card();
+	gchar *card_name = prefs_get_string("AlsaCard", NULL);
+	gchar *channel = NULL;
+	gboolean done = FALSE;
+
+	cancel_slider_write();
+
+	if (card && card_name && !strcmp(card->name, card_name)) {
+		channel = prefs_get_channel(card_name);
+		done = alsa_set_channel(channel);
+	}
+	g_free(card_name);
+	g_free(channel);
+
+	if (!done) {
+		do_alsa_reinit();
+		return;
+	}
+
+	get_current_levels();
+	update_vol_text();
+	on_volume_has_changed();
+}
+
 /**
  * Creates and opens the about window from about-gtk3.glade or
  * about-gtk2.glade, triggered by clicking on the GtkImageMenuItem
@@ -527,96 +656,349 @@ get_current_levels(void)
 	gtk_adjustment_set_value(GTK_ADJUSTMENT(vol_adjustment), (double) tmpvol);
 }
 
-static float vol_div_factor;
-static int vol_meter_width;
-static guchar *vol_meter_row = NULL;
+/**
+ * Styles of the volume meter drawn on top of the tray icon,
+ * see the VolMeterStyle preference.
+ */
+enum {
+	VOL_METER_BAR,		/**< vertical bar, the height is the volume */
+	VOL_METER_RING,		/**< ring around the icon, the arc is the volume */
+	VOL_METER_NUMERIC,	/**< the volume as a number */
+	N_VOL_METER_STYLES
+};
+
+static int vol_meter_style = VOL_METER_BAR;
+static gdouble vol_meter_rgb[3];
+static int draw_offset = 0;
 
 /**
- * Draws the volume meter on top of the icon.
- *
- * @param pixbuf the GdkPixbuf icon to draw the volume meter on
- * @param x offset
- * @param y offset
- * @param h height of the volume meter
+ * Size of the icons with the volume meter, in logical pixels,
+ * and the scale factor to device pixels.
+ */
+static int meter_icon_size, meter_icon_scale;
+
+/**
+ * Surface the icons with the volume meter are rendered into,
+ * allocated once per icon size by update_status_icons().
+ */
+static cairo_surface_t *vol_meter_surface = NULL;
+
+/**
+ * Icons with the volume meter drawn on top, for each volume icon
+ * and each meter value at the current icon size, indexed by
+ * icon * n_meter_values + value. They are filled lazily by
+ * get_vol_meter_icon() and cleared by update_status_icons().
+ */
+static GdkPixbuf **vol_meter_icons = NULL;
+static int n_meter_values = 0;
+
+/**
+ * Frees the icons with the volume meter drawn on top, as well
+ * as the surface they are rendered into.
  */
 static void
-draw_vol_meter(GdkPixbuf *pixbuf, int x, int y, int h)
+clear_vol_meter_icons(void)
+{
+	int i;
+
+	if (vol_meter_surface) {
+		cairo_surface_destroy(vol_meter_surface);
+		vol_meter_surface = NULL;
+	}
+
+	if (!vol_meter_icons)
+		return;
+
+	for (i = 0; i < N_VOLUME_ICONS * n_meter_values; i++)
+		if (vol_meter_icons[i])
+			g_object_unref(vol_meter_icons[i]);
+	g_free(vol_meter_icons);
+	vol_meter_icons = NULL;
+	n_meter_values = 0;
+}
+
+/**
+ * Gets the number of distinct meter values for the meter style
+ * and the icon size. For the bar, that's the number of heights
+ * in device pixels, for the other styles, one per volume step.
+ *
+ * @return the number of meter values
+ */
+static int
+count_meter_values(void)
 {
-	int width, height, rowstride, n_channels, i;
-	guchar *pixels, *p;
+	int n;
 
-	n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+	if (vol_meter_style != VOL_METER_BAR)
+		return 101;
 
-	g_assert(gdk_pixbuf_get_colorspace(pixbuf) == GDK_COLORSPACE_RGB);
-	g_assert(gdk_pixbuf_get_bits_per_sample(pixbuf) == 8);
-	g_assert(gdk_pixbuf_get_has_alpha(pixbuf));
-	g_assert(n_channels == 4);
+	n = (meter_icon_size - 10) * meter_icon_scale + 1;
+	return MAX(n, 1);
+}
 
-	width = gdk_pixbuf_get_width(pixbuf);
-	height = gdk_pixbuf_get_height(pixbuf);
+/**
+ * Converts a volume into a meter value, see count_meter_values().
+ *
+ * @param vol the volume in the range from 0 - 100
+ * @return the meter value
+ */
+static int
+vol_to_meter_value(int vol)
+{
+	vol = CLAMP(vol, 0, 100);
+	if (vol_meter_style != VOL_METER_BAR)
+		return vol;
 
-	g_assert(x >= 0 && x < width);
-	g_assert(y + h >= 0 && y < height);
+	return vol * (n_meter_values - 1) / 100;
+}
 
-	rowstride = gdk_pixbuf_get_rowstride(pixbuf);
-	pixels = gdk_pixbuf_get_pixels(pixbuf);
+/**
+ * Draws the volume meter. The coordinates are in logical pixels,
+ * the icon being meter_icon_size wide.
+ *
+ * @param cr the cairo context
+ * @param vol the volume in the range from 0 - 100
+ * @param value the meter value, see vol_to_meter_value()
+ */
+static void
+draw_vol_meter(cairo_t *cr, int vol, int value)
+{
+	double size = meter_icon_size;
+	double r = vol_meter_rgb[0], g = vol_meter_rgb[1], b = vol_meter_rgb[2];
+
+	switch (vol_meter_style) {
+	case VOL_METER_RING: {
+		double radius = size * 0.42, width = size * 0.12;
+
+		cairo_set_line_width(cr, width);
+		cairo_set_source_rgba(cr, r, g, b, 0.3);
+		cairo_arc(cr, size / 2, size / 2, radius, 0, 2 * G_PI);
+		cairo_stroke(cr);
+
+		cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+		cairo_set_source_rgba(cr, r, g, b, 1.0);
+		cairo_arc(cr, size / 2, size / 2, radius, -G_PI / 2,
+			  -G_PI / 2 + 2 * G_PI * value / 100.0);
+		if (value > 0)
+			cairo_stroke(cr);
+		cairo_new_path(cr);
+		break;
+	}
+	case VOL_METER_NUMERIC: {
+		cairo_text_extents_t ext;
+		char text[4];
+		double pad = size * 0.06;
+
+		snprintf(text, sizeof(text), "%d", vol);
+		cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL,
+				       CAIRO_FONT_WEIGHT_BOLD);
+		cairo_set_font_size(cr, size * 0.45);
+		cairo_text_extents(cr, text, &ext);
+
+		cairo_set_source_rgba(cr, 0, 0, 0, 0.6);
+		cairo_rectangle(cr, size - ext.width - 3 * pad,
+				size - ext.height - 3 * pad,
+				ext.width + 2 * pad, ext.height + 2 * pad);
+		cairo_fill(cr);
+
+		cairo_set_source_rgba(cr, r, g, b, 1.0);
+		cairo_move_to(cr, size - ext.width - 2 * pad - ext.x_bearing,
+			      size - 2 * pad - ext.height - ext.y_bearing);
+		cairo_show_text(cr, text);
+		break;
+	}
+	case VOL_METER_BAR:
+	default: {
+		double h = value / (double) meter_icon_scale;
+
+		cairo_set_source_rgba(cr, r, g, b, 1.0);
+		cairo_rectangle(cr, draw_offset, size - 5 - h,
+				size * 0.3125, h);
+		cairo_fill(cr);
+		break;
+	}
+	}
+}
 
-	y = height - y;
-	for (i = 0; i < h; i++) {
-		p = pixels + (y - i) * rowstride + x * n_channels;
-		memcpy(p, vol_meter_row, vol_meter_width);
+/**
+ * Copies the content of an ARGB32 cairo surface into a pixbuf of
+ * the same size, converting from premultiplied alpha.
+ *
+ * @param surface the cairo surface
+ * @param pixbuf the RGBA GdkPixbuf to copy into
+ */
+static void
+surface_to_pixbuf(cairo_surface_t *surface, GdkPixbuf *pixbuf)
+{
+	int width = cairo_image_surface_get_width(surface);
+	int height = cairo_image_surface_get_height(surface);
+	int src_stride = cairo_image_surface_get_stride(surface);
+	int dst_stride = gdk_pixbuf_get_rowstride(pixbuf);
+	guchar *src = cairo_image_surface_get_data(surface);
+	guchar *dst = gdk_pixbuf_get_pixels(pixbuf);
+	int x, y;
+
+	cairo_surface_flush(surface);
+
+	for (y = 0; y < height; y++) {
+		guint32 *s = (guint32 *) (src + y * src_stride);
+		guchar *d = dst + y * dst_stride;
+
+		for (x = 0; x < width; x++, d += 4) {
+			guint32 p = s[x];
+			guint a = p >> 24;
+
+			d[3] = a;
+			if (a == 0) {
+				d[0] = d[1] = d[2] = 0;
+				continue;
+			}
+			d[0] = (((p >> 16) & 0xff) * 255 + a / 2) / a;
+			d[1] = (((p >> 8) & 0xff) * 255 + a / 2) / a;
+			d[2] = ((p & 0xff) * 255 + a / 2) / a;
+		}
 	}
 }
 
-static int draw_offset = 0;
-static GdkPixbuf *icon_copy = NULL;
+/**
+ * Renders a volume icon with the volume meter drawn on top, at
+ * the size of the tray icon in device pixels.
+ *
+ * @param icon the volume icon, e.g. VOLUME_LOW
+ * @param vol the volume in the range from 0 - 100
+ * @param value the meter value, see vol_to_meter_value()
+ * @return the new icon
+ */
+static GdkPixbuf *
+render_vol_meter_icon(int icon, int vol, int value)
+{
+	GdkPixbuf *base = status_icons[icon], *pixbuf;
+	int size = meter_icon_size * meter_icon_scale;
+	cairo_t *cr;
+
+	if (vol_meter_surface == NULL)
+		vol_meter_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+							       size, size);
+
+	cr = cairo_create(vol_meter_surface);
+	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+	cairo_paint(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+	// the icon, scaled to the device size
+	cairo_save(cr);
+	cairo_scale(cr, size / (double) gdk_pixbuf_get_width(base),
+		    size / (double) gdk_pixbuf_get_height(base));
+	gdk_cairo_set_source_pixbuf(cr, base, 0, 0);
+	cairo_paint(cr);
+	cairo_restore(cr);
+
+	// the meter, in logical pixels
+	cairo_scale(cr, meter_icon_scale, meter_icon_scale);
+	draw_vol_meter(cr, vol, value);
+	cairo_destroy(cr);
+
+	pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, size, size);
+	surface_to_pixbuf(vol_meter_surface, pixbuf);
+
+	return pixbuf;
+}
+
+/**
+ * Gets a volume icon with the volume meter drawn on top. The icon
+ * is rendered the first time its meter value is needed, afterwards
+ * it's just a lookup.
+ *
+ * @param icon the volume icon, e.g. VOLUME_LOW
+ * @param vol the volume in the range from 0 - 100
+ * @return the icon, owned by vol_meter_icons
+ */
+static GdkPixbuf *
+get_vol_meter_icon(int icon, int vol)
+{
+	GdkPixbuf **slot;
+	int value = vol_to_meter_value(vol);
+
+	slot = &vol_meter_icons[icon * n_meter_values + value];
+	if (*slot == NULL)
+		*slot = render_vol_meter_icon(icon, vol, value);
+
+	return *slot;
+}
+
+/**
+ * What was last pushed to the tray icon, so that update_tray_icon()
+ * only pushes what changed to Gtk+ and to the system tray.
+ */
+struct tray_state {
+	/**
+	 * The icon shown, which stands for the volume icon and the
+	 * height of the volume meter. NULL if unknown.
+	 */
+	GdkPixbuf *icon;
+	/**
+	 * The inputs of the tooltip.
+	 */
+	int volume;
+	int muted;
+	struct acard *card;
+	const char *channel;
+};
+
+static struct tray_state tray_state = { NULL, -1, -1, NULL, NULL };
 
 /**
  * Updates the tray icon. Usually called after volume has been muted
- * or changed.
+ * or changed. Only what changed since the last call is pushed,
+ * see struct tray_state. The tooltip itself is built on demand
+ * by tray_icon_query_tooltip().
  */
 void
 update_tray_icon(void)
 {
-	int muted;
+	int muted = ismuted();
 	int tmpvol = getvol();
-	char tooltip[60];
-	gchar *active_card_name = (alsa_get_active_card())->name;
-	const char *active_channel = alsa_get_active_channel();
-
-	muted = ismuted();
+	struct acard *card = alsa_get_active_card();
+	const char *channel = alsa_get_active_channel();
+	GdkPixbuf *pixbuf;
 
 	if (muted == 1) {
-		GdkPixbuf *icon;
+		int icon;
 
 		if (tmpvol == 0)
-			icon = status_icons[VOLUME_OFF];
+			icon = VOLUME_OFF;
 		else if (tmpvol < 33)
-			icon = status_icons[VOLUME_LOW];
+			icon = VOLUME_LOW;
 		else if (tmpvol < 66)
-			icon = status_icons[VOLUME_MEDIUM];
+			icon = VOLUME_MEDIUM;
+		else
+			icon = VOLUME_HIGH;
+
+		if (vol_meter_icons)
+			pixbuf = get_vol_meter_icon(icon, tmpvol);
 		else
-			icon = status_icons[VOLUME_HIGH];
-		sprintf(tooltip, _("%s (%s)\nVolume: %d %%"), active_card_name,
-			active_channel,
-			tmpvol);
-
-		if (vol_meter_row) {
-			GdkPixbuf *old_icon = icon_copy;
-			icon_copy = gdk_pixbuf_copy(icon);
-			draw_vol_meter(icon_copy, draw_offset, 5,
-				       (tmpvol * vol_div_factor));
-			if (old_icon)
-				g_object_unref(old_icon);
-			gtk_status_icon_set_from_pixbuf(tray_icon, icon_copy);
-		} else
-			gtk_status_icon_set_from_pixbuf(tray_icon, icon);
+			pixbuf = status_icons[icon];
 	} else {
-		gtk_status_icon_set_from_pixbuf(tray_icon, status_icons[VOLUME_MUTED]);
-		sprintf(tooltip, _("%s (%s)\nVolume: %d %%\nMuted"), active_card_name,
-			active_channel, tmpvol);
+		pixbuf = status_icons[VOLUME_MUTED];
+	}
+
+	if (pixbuf != tray_state.icon) {
+		gtk_status_icon_set_from_pixbuf(tray_icon, pixbuf);
+		tray_state.icon = pixbuf;
+	}
+
+	// refresh the tooltip if its text changed while it's shown,
+	// querying the tooltips goes through the whole display
+	if (tmpvol != tray_state.volume || muted != tray_state.muted ||
+	    card != tray_state.card || channel != tray_state.channel) {
+		tray_state.volume = tmpvol;
+		tray_state.muted = muted;
+		tray_state.card = card;
+		tray_state.channel = channel;
+		if (tray_tooltip_visible())
+			gtk_tooltip_trigger_tooltip_query
+				(gdk_display_get_default());
 	}
-	gtk_status_icon_set_tooltip_text(tray_icon, tooltip);
 }
 
 /**
@@ -627,6 +1009,21 @@ update_tray_icon(void)
 void
 update_mute_checkboxes(void)
 {
+	gboolean active = ismuted() == 0;
+
+	/* nothing to do if the checkboxes are in sync already */
+	if (gtk_toggle_button_get_active(
+		    GTK_TOGGLE_BUTTON(mute_check_popup_window)) == active &&
+#ifdef WITH_GTK3
+	    gtk_toggle_button_get_active(
+		    GTK_TOGGLE_BUTTON(mute_check_popup_menu)) == active
+#else
+	    gtk_check_menu_item_get_active(
+		    GTK_CHECK_MENU_ITEM(mute_check_popup_menu)) == active
+#endif
+	   )
+		return;
+
 	/* we only want to update the icons and not emit any signals */
 	g_signal_handler_block(G_OBJECT(mute_check_popup_menu),
 				mute_check_popup_menu_handler);
@@ -745,8 +1142,6 @@ hide_me(G_GNUC_UNUSED GtkWidget *widget,
 	return FALSE;
 }
 
-static guchar vol_meter_red, vol_meter_green, vol_meter_blue;
-
 /**
  * Sets the color of the volume meter which is drawn on top
  * of the tray_icon.
@@ -758,29 +1153,139 @@ static guchar vol_meter_red, vol_meter_green, vol_meter_blue;
 void
 set_vol_meter_color(gdouble nr, gdouble ng, gdouble nb)
 {
-	vol_meter_red = nr * 255;
-	vol_meter_green = ng * 255;
-	vol_meter_blue = nb * 255;
+	vol_meter_rgb[0] = nr;
+	vol_meter_rgb[1] = ng;
+	vol_meter_rgb[2] = nb;
 }
 
 /**
- * Updates all status icons for the different volume states like
- * muted, low, medium, high as well as the volume meter. This
- * is triggered either by apply_prefs() in the preferences subsystem,
- * do_alsa_reinit() or tray_icon_resized().
+ * What the status icons were loaded for. The icons are only reloaded
+ * when one of these changes, or when the icon theme changes.
  */
-void
-update_status_icons(void)
+struct icons_key {
+	/**
+	 * Whether the icons are valid.
+	 */
+	gboolean valid;
+	/**
+	 * Whether the icons come from the icon theme, instead of
+	 * the PNMixer icons. The fields below only matter if set.
+	 */
+	gboolean system_theme;
+	/**
+	 * Name of the icon theme.
+	 */
+	gchar *theme_name;
+	/**
+	 * Size of the icons.
+	 */
+	gint size;
+	/**
+	 * Scale factor of the screen.
+	 */
+	gint scale;
+};
+
+static struct icons_key icons_key = { FALSE, FALSE, NULL, 0, 0 };
+
+/**
+ * Returns the scale factor of the screen the tray icon is on.
+ *
+ * @return the scale factor, 1 if unknown
+ */
+static gint
+tray_icon_scale(void)
+{
+#if defined(WITH_GTK3) && GTK_CHECK_VERSION(3, 10, 0)
+	GdkScreen *screen = tray_icon ? gtk_status_icon_get_screen(tray_icon)
+			    : gdk_screen_get_default();
+	return gdk_screen_get_monitor_scale_factor(screen, 0);
+#else
+	return 1;
+#endif
+}
+
+/**
+ * Handles the 'changed' signal on the GtkIconTheme, by reloading
+ * the status icons.
+ *
+ * @param theme the object which received the signal
+ * @param user_data set when the signal handler was connected
+ */
+static void
+on_icon_theme_changed(G_GNUC_UNUSED GtkIconTheme *theme,
+		      G_GNUC_UNUSED gpointer user_data)
+{
+	if (!icons_key.system_theme)
+		return;
+
+	DEBUG_PRINT("Icon theme changed");
+	icons_key.valid = FALSE;
+	update_status_icons();
+}
+
+/**
+ * Checks the status icons against what they should be loaded for,
+ * and updates icons_key.
+ *
+ * @return TRUE if the status icons must be (re)loaded
+ */
+static gboolean
+status_icons_outdated(void)
+{
+	gboolean system_theme = settings.system_theme;
+	gchar *theme_name = NULL;
+	gint size = 0, scale = 0;
+	gboolean outdated;
+
+	if (system_theme) {
+		static gulong theme_handler = 0;
+
+		if (icon_theme == NULL)
+			icon_theme = gtk_icon_theme_get_default();
+		if (theme_handler == 0)
+			theme_handler = g_signal_connect(icon_theme, "changed",
+					G_CALLBACK(on_icon_theme_changed), NULL);
+
+		g_object_get(gtk_settings_get_default(), "gtk-icon-theme-name",
+			     &theme_name, NULL);
+		size = tray_icon_size();
+		scale = tray_icon_scale();
+	}
+
+	outdated = !icons_key.valid ||
+		   system_theme != icons_key.system_theme ||
+		   g_strcmp0(theme_name, icons_key.theme_name) ||
+		   size != icons_key.size || scale != icons_key.scale;
+
+	g_free(icons_key.theme_name);
+	icons_key.valid = TRUE;
+	icons_key.system_theme = system_theme;
+	icons_key.theme_name = theme_name;
+	icons_key.size = size;
+	icons_key.scale = scale;
+
+	return outdated;
+}
+
+/**
+ * Loads the status icons for the different volume states like
+ * muted, low, medium, high, according to icons_key.
+ */
+static void
+load_status_icons(void)
 {
-	int i, icon_width;
+	int i;
 	GdkPixbuf *old_icons[N_VOLUME_ICONS];
-	int size = tray_icon_size();
+	int size = icons_key.size;
 
 	for (i = 0; i < N_VOLUME_ICONS; i++)
 		old_icons[i] = status_icons[i];
 
 	/* Handle icons depending on the theme */
-	if (prefs_get_boolean("SystemTheme", FALSE)) {
+	if (icons_key.system_theme) {
+		DEBUG_PRINT("Loading status icons from theme '%s', size %d",
+			    icons_key.theme_name, size);
 		status_icons[VOLUME_MUTED] = get_stock_pixbuf("audio-volume-muted",
 					     size);
 		status_icons[VOLUME_OFF] = get_stock_pixbuf("audio-volume-off", size);
@@ -796,6 +1301,7 @@ update_status_icons(void)
 			status_icons[VOLUME_OFF] = get_stock_pixbuf("audio-volume-low",
 						   size);
 	} else {
+		DEBUG_PRINT("Loading PNMixer status icons");
 		status_icons[VOLUME_MUTED] = create_pixbuf("pnmixer-muted.png");
 		status_icons[VOLUME_OFF] = create_pixbuf("pnmixer-off.png");
 		status_icons[VOLUME_LOW] = create_pixbuf("pnmixer-low.png");
@@ -803,44 +1309,61 @@ update_status_icons(void)
 		status_icons[VOLUME_HIGH] = create_pixbuf("pnmixer-high.png");
 	}
 
+	for (i = 0; i < N_VOLUME_ICONS; i++)
+		if (old_icons[i])
+			g_object_unref(old_icons[i]);
+}
+
+/**
+ * Updates all status icons for the different volume states like
+ * muted, low, medium, high as well as the volume meter. This
+ * is triggered either by apply_prefs() in the preferences subsystem,
+ * do_alsa_reinit(), tray_icon_resized() or a change of the icon theme.
+ * The icons themselves are only reloaded if they are outdated,
+ * see status_icons_outdated().
+ */
+void
+update_status_icons(void)
+{
+	static guint meter_generation;
+	gboolean reloaded = FALSE;
+
+	if (status_icons_outdated()) {
+		load_status_icons();
+		reloaded = TRUE;
+	}
+
 	/* Handle volume meter */
-	icon_width = gdk_pixbuf_get_height(status_icons[0]);
-	vol_div_factor = ((gdk_pixbuf_get_height(status_icons[0]) - 10) / 100.0);
-	vol_meter_width = 1.25 * icon_width;
-	if (vol_meter_width % 4 != 0)
-		vol_meter_width -= (vol_meter_width % 4);
-
-	if (prefs_get_boolean("DrawVolMeter", FALSE)) {
-		int lim;
-
-		if (vol_meter_row)
-			g_free(vol_meter_row);
-		vol_meter_row = g_malloc(vol_meter_width * sizeof(guchar));
-
-		lim = vol_meter_width / 4;
-		for (i = 0; i < lim; i++) {
-			vol_meter_row[i * 4] = vol_meter_red;
-			vol_meter_row[i * 4 + 1] = vol_meter_green;
-			vol_meter_row[i * 4 + 2] = vol_meter_blue;
-			vol_meter_row[i * 4 + 3] = 255;
-		}
-	} else {
-		if (vol_meter_row)
-			g_free(vol_meter_row);
-		vol_meter_row = NULL;
-		if (icon_copy)
-			g_object_unref(icon_copy);
-		icon_copy = NULL;
+	// neither the base icons nor the settings changed,
+	// the rendered icons are still good
+	if (!reloaded && meter_generation == settings.generation &&
+	    meter_icon_size == tray_icon_size() &&
+	    meter_icon_scale == tray_icon_scale())
+		goto push;
+	meter_generation = settings.generation;
+
+	// the rendered icons are out of date
+	clear_vol_meter_icons();
+
+	if (settings.draw_vol_meter) {
+		vol_meter_style = settings.vol_meter_style;
+		if (vol_meter_style < 0 || vol_meter_style >= N_VOL_METER_STYLES)
+			vol_meter_style = VOL_METER_BAR;
+		draw_offset = settings.vol_meter_pos;
+		meter_icon_size = tray_icon_size();
+		meter_icon_scale = tray_icon_scale();
+
+		n_meter_values = count_meter_values();
+		vol_meter_icons = g_new0(GdkPixbuf *,
+					 N_VOLUME_ICONS * n_meter_values);
 	}
 
-	draw_offset = prefs_get_integer("VolMeterPos", 0);
+	// the icon may have been freed, push it again
+	tray_state.icon = NULL;
 
+push:
 	if (tray_icon)
 		on_volume_has_changed();
-
-	for (i = 0; i < N_VOLUME_ICONS; i++)
-		if (old_icons[i])
-			g_object_unref(old_icons[i]);
 }
 
 /**
@@ -949,10 +1472,16 @@ main(int argc, char *argv[])
 		g_signal_connect(G_OBJECT(mute_check_popup_window),
 				"toggled", G_CALLBACK(on_mute_clicked), NULL);
 
-	apply_prefs(0);
+	apply_prefs(ALSA_CHANGE_NONE);
+	prefs_start_watch();
+	if (settings.osd_enable)
+		osd_init();
 
 	gtk_main();
+	prefs_stop_watch();
+	prefs_flush();
 	uninit_libnotify();
+	osd_free();
 	alsa_close();
 	return 0;
 }
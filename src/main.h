@@ -31,6 +31,8 @@ void create_popups(void);
 void create_about(void);
 void do_prefs(void);
 void do_alsa_reinit(void);
+void do_alsa_card_change(void);
+void do_alsa_channel_change(void);
 
 void report_error(char *, ...);
 void warn_sound_conn_lost(void);
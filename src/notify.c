@@ -12,6 +12,8 @@
  * @file notify.c
  * This file handles the notification subsystem
  * via libnotify and mostly reacts to volume changes.
+ * The notifications themselves are sent with asynchronous
+ * D-Bus calls, as libnotify only shows them synchronously.
  * @brief libnotify subsystem
  */
 
@@ -19,32 +21,48 @@
 #include "config.h"
 #endif
 
+#include <string.h>
+#include <gio/gio.h>
+
 #include "alsa.h"
 #include "main.h"
 #include "notify.h"
+#include "osd.h"
 #include "prefs.h"
 #include "support.h"
+#include "debug.h"
+
+/**
+ * Checks whether the notifications of a source are enabled
+ * in the user settings.
+ *
+ * @param source the source, see enum noti_source
+ * @return TRUE if they are enabled
+ */
+static gboolean
+noti_source_enabled(gint source)
+{
+	if (!enable_noti)
+		return FALSE;
+
+	switch (source) {
+	case NOTI_SOURCE_HOTKEY:
+		return hotkey_noti;
+	case NOTI_SOURCE_MOUSE:
+		return mouse_noti;
+	case NOTI_SOURCE_POPUP:
+		return popup_noti;
+	case NOTI_SOURCE_EXTERNAL:
+		return external_noti;
+	default:
+		return FALSE;
+	}
+}
 
 #ifdef HAVE_LIBN
 
 // code for when we have libnotify
 
-#if NOTIFY_CHECK_VERSION (0, 7, 0)
-#define NOTIFICATION_NEW(summary, body, icon)	\
-  notify_notification_new(summary, body, icon)
-#define NOTIFICATION_SET_HINT_STRING(notification, key, value)		\
-  notify_notification_set_hint(notification, key, g_variant_new_string(value))
-#define NOTIFICATION_SET_HINT_INT32(notification, key, value)		\
-  notify_notification_set_hint(notification, key, g_variant_new_int32(value))
-#else
-#define NOTIFICATION_NEW(summary, body, icon)		\
-  notify_notification_new(summary, body, icon, NULL)
-#define NOTIFICATION_SET_HINT_STRING(notification, key, value)	\
-  notify_notification_set_hint_string(notification, key, value)
-#define NOTIFICATION_SET_HINT_INT32(notification, key, value)	\
-  notify_notification_set_hint_int32(notification, key, value)
-#endif
-
 /**
  * We need to report error in idle moment
  * since we can't report_error before gtk_main is called.
@@ -63,112 +81,538 @@ idle_report_error(G_GNUC_UNUSED gpointer data)
 }
 
 /**
- * Initializes libnotify if it's not already
- * initialized.
+ * The contents of a notification. Everything it needs is copied
+ * when it's queued, so that sending it doesn't depend on the state
+ * of the other subsystems at that time.
  */
-void
-init_libnotify()
+struct pending_noti {
+	/**
+	 * Whether there's something to send.
+	 */
+	gboolean pending;
+	/**
+	 * The summary of the notification.
+	 */
+	gchar *summary;
+	/**
+	 * The body of the notification, or NULL.
+	 */
+	gchar *body;
+	/**
+	 * The icon name, or NULL.
+	 */
+	const gchar *icon;
+	/**
+	 * The volume level, or -1 if it's not a volume notification.
+	 */
+	gint level;
+	/**
+	 * The timeout of the notification, in ms.
+	 */
+	gint timeout;
+};
+
+/**
+ * A notification which replaces itself when shown again. It's sent
+ * with an asynchronous D-Bus call, so that a slow or hung notification
+ * daemon doesn't hold up the main loop. There's at most one call in
+ * flight, notifications queued in the meantime replace each other and
+ * only the latest one is sent once the daemon answered.
+ */
+struct noti_slot {
+	/**
+	 * The notification waiting for the call in flight, if any.
+	 */
+	struct pending_noti pending;
+	/**
+	 * Whether a call to the notification daemon is in flight.
+	 */
+	gboolean in_flight;
+	/**
+	 * The id the daemon gave to the notification, 0 if none.
+	 */
+	guint32 id;
+};
+
+static struct noti_slot volume_slot;
+static struct noti_slot text_slot;
+
+/**
+ * The session bus, NULL if notifications can't be sent.
+ */
+static GDBusConnection *noti_bus = NULL;
+
+/**
+ * Cancels the calls in flight when notifications are uninitialized.
+ */
+static GCancellable *noti_cancellable = NULL;
+
+/**
+ * Clears a pending notification.
+ *
+ * @param noti the pending notification
+ */
+static void
+clear_pending_noti(struct pending_noti *noti)
 {
-	if (!notify_is_initted())
-		if (!notify_init(PACKAGE))
-			g_idle_add(idle_report_error, NULL);
+	g_free(noti->summary);
+	g_free(noti->body);
+	memset(noti, 0, sizeof(*noti));
 }
 
+static void send_slot(struct noti_slot *slot);
+
 /**
- * Uninitializes libnotify if it is initialized.
+ * Callback of the D-Bus call showing a notification, see send_slot().
+ * Remembers the id of the notification so that the next one replaces
+ * it, and sends the notification queued in the meantime, if any.
+ * Failures are logged with g_warning() rather than report_error(),
+ * whose dialog would be a nuisance each time the volume changes while
+ * there's no notification daemon, and only the first of consecutive
+ * failures is logged.
+ *
+ * @param source the bus
+ * @param res the result of the call
+ * @param data the slot
  */
-void
-uninit_libnotify()
+static void
+on_noti_sent(GObject *source, GAsyncResult *res, gpointer data)
 {
-	if (notify_is_initted())
-		notify_uninit();
+	static gboolean failing = FALSE;
+	struct noti_slot *slot = data;
+	GError *error = NULL;
+	GVariant *reply;
+
+	reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res,
+					      &error);
+
+	// uninit_libnotify() cancelled the call and reset the slot
+	if (noti_bus == NULL ||
+	    g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		if (reply)
+			g_variant_unref(reply);
+		if (error)
+			g_error_free(error);
+		return;
+	}
+
+	if (reply) {
+		failing = FALSE;
+		g_variant_get(reply, "(u)", &slot->id);
+		g_variant_unref(reply);
+	} else {
+		if (!failing)
+			g_warning(_("Could not send notification: %s"),
+				  error->message);
+		failing = TRUE;
+		g_error_free(error);
+	}
+
+	slot->in_flight = FALSE;
+	send_slot(slot);
 }
 
 /**
- * Send a volume notification. This is mainly called
- * from the alsa subsystem whenever we have volume
- * changes.
+ * Sends the pending notification of a slot to the notification
+ * daemon, unless a call is already in flight, in which case
+ * on_noti_sent() sends it afterwards.
  *
- * @param level the playback volume level
- * @param muted whether the playback is muted
+ * @param slot the slot
  */
-void
-do_notify_volume(gint level, gboolean muted)
+static void
+send_slot(struct noti_slot *slot)
 {
-	static NotifyNotification *notification = NULL;
-	gchar *summary, *icon, *active_card_name;
-	const char *active_channel;
-	GError *error = NULL;
+	struct pending_noti *noti = &slot->pending;
+	const gchar *no_actions[] = { NULL };
+	GVariantBuilder hints;
+
+	if (slot->in_flight || !noti->pending || noti_bus == NULL)
+		return;
 
-	active_card_name = (alsa_get_active_card())->name;
-	active_channel = alsa_get_active_channel();
+	g_variant_builder_init(&hints, G_VARIANT_TYPE("a{sv}"));
+	g_variant_builder_add(&hints, "{sv}", "x-canonical-private-synchronous",
+			      g_variant_new_string(""));
+	if (noti->level >= 0)
+		g_variant_builder_add(&hints, "{sv}", "value",
+				      g_variant_new_int32(noti->level));
 
-	if (notification == NULL) {
-		notification = NOTIFICATION_NEW("", NULL, NULL);
-		notify_notification_set_timeout(notification, noti_timeout);
-		NOTIFICATION_SET_HINT_STRING(notification,
-					     "x-canonical-private-synchronous", "");
+	g_dbus_connection_call(noti_bus, "org.freedesktop.Notifications",
+			       "/org/freedesktop/Notifications",
+			       "org.freedesktop.Notifications", "Notify",
+			       g_variant_new("(susss@asa{sv}i)",
+					     notify_get_app_name(), slot->id,
+					     noti->icon ? noti->icon : "",
+					     noti->summary,
+					     noti->body ? noti->body : "",
+					     g_variant_new_strv(no_actions, 0),
+					     &hints, noti->timeout),
+			       G_VARIANT_TYPE("(u)"), G_DBUS_CALL_FLAGS_NONE,
+			       -1, noti_cancellable, on_noti_sent, slot);
+
+	slot->in_flight = TRUE;
+	clear_pending_noti(noti);
+}
+
+/**
+ * Queues a notification in a slot, replacing the pending one if it
+ * wasn't sent yet, and sends it if the slot isn't busy.
+ * Takes ownership of the strings of noti.
+ *
+ * @param slot the slot
+ * @param noti the new notification
+ */
+static void
+queue_noti(struct noti_slot *slot, struct pending_noti *noti)
+{
+	if (noti_bus == NULL) {
+		clear_pending_noti(noti);
+		return;
 	}
 
+	noti->pending = TRUE;
+	clear_pending_noti(&slot->pending);
+	slot->pending = *noti;
+
+	send_slot(slot);
+}
+
+/**
+ * Formats a volume notification and sends it. If a previous one
+ * is still being sent, only the latest volume is sent afterwards.
+ *
+ * @param level the playback volume level
+ * @param muted whether the playback is muted
+ */
+static void
+send_volume_noti(gint level, gboolean muted)
+{
+	struct pending_noti noti = { 0 };
+	struct acard *card = alsa_get_active_card();
+
 	if (level < 0)
 		level = 0;
 	if (level > 100)
 		level = 100;
 
 	if (muted)
-		summary = g_strdup("Volume muted");
+		noti.summary = g_strdup("Volume muted");
 	else
-		summary =
+		noti.summary =
 			g_strdup_printf("%s (%s)\nVolume: %d%%\n",
-					active_card_name, active_channel, level);
+					card ? card->name : "",
+					alsa_get_active_channel(), level);
 
 	if (muted)
-		icon = "audio-volume-muted";
+		noti.icon = "audio-volume-muted";
 	else if (level == 0)
-		icon = "audio-volume-off";
+		noti.icon = "audio-volume-off";
 	else if (level < 33)
-		icon = "audio-volume-low";
+		noti.icon = "audio-volume-low";
 	else if (level < 66)
-		icon = "audio-volume-medium";
+		noti.icon = "audio-volume-medium";
 	else
-		icon = "audio-volume-high";
+		noti.icon = "audio-volume-high";
 
-	notify_notification_update(notification, summary, NULL, icon);
-	NOTIFICATION_SET_HINT_INT32(notification, "value", level);
+	noti.level = level;
+	noti.timeout = noti_timeout;
 
-	if (!notify_notification_show(notification, &error)) {
-		report_error(_("Could not send notification: %s"), error->message);
-		g_error_free(error);
+	queue_noti(&volume_slot, &noti);
+}
+
+/**
+ * Rate limit of the volume notifications of a source. This is a token
+ * bucket holding up to NotificationBurst tokens, refilled by one token
+ * every NotificationInterval ms, each notification taking one token.
+ * What happens to the notifications when the bucket is empty is given
+ * by NotificationPolicy, see enum noti_policy.
+ */
+struct noti_limiter {
+	/**
+	 * Tokens left in the bucket.
+	 */
+	gdouble tokens;
+	/**
+	 * When the bucket was last refilled, in monotonic time,
+	 * 0 if never.
+	 */
+	gint64 refilled;
+	/**
+	 * Source id of the timeout sending the held back
+	 * notification, or 0.
+	 */
+	guint timeout_id;
+	/**
+	 * Whether a notification is held back.
+	 */
+	gboolean held;
+	/**
+	 * The volume level of the held back notification.
+	 */
+	gint level;
+	/**
+	 * Whether the playback is muted in the held back notification.
+	 */
+	gboolean muted;
+	/**
+	 * How many notifications were suppressed so far, either dropped
+	 * or replaced by a later one.
+	 */
+	guint suppressed;
+};
+
+/**
+ * The rate limits, one per source, see enum noti_source.
+ */
+static struct noti_limiter limiters[N_NOTI_SOURCES];
+
+/**
+ * Names of the sources, for debugging.
+ */
+static const gchar *noti_source_names[N_NOTI_SOURCES] = {
+	"none", "hotkey", "mouse", "popup", "external"
+};
+
+/**
+ * Refills the token bucket of a limiter for the time elapsed
+ * since the last refill.
+ *
+ * @param lim the limiter
+ */
+static void
+refill_limiter(struct noti_limiter *lim)
+{
+	gint64 now = g_get_monotonic_time();
+
+	if (lim->refilled == 0)
+		lim->tokens = settings.noti_burst;
+	else
+		lim->tokens += (now - lim->refilled) /
+			(settings.noti_interval * 1000.0);
+
+	lim->tokens = MIN(lim->tokens, settings.noti_burst);
+	lim->refilled = now;
+}
+
+/**
+ * Sends a volume notification, taking a token of the limiter.
+ *
+ * @param lim the limiter
+ * @param level the playback volume level
+ * @param muted whether the playback is muted
+ */
+static void
+limiter_send(struct noti_limiter *lim, gint level, gboolean muted)
+{
+	lim->tokens = MAX(lim->tokens - 1, 0);
+	send_volume_noti(level, muted);
+
+	if (lim->suppressed)
+		DEBUG_PRINT("%s notifications: %u suppressed so far",
+			    noti_source_names[lim - limiters], lim->suppressed);
+}
+
+/**
+ * Sends the notification held back by a limiter.
+ * This function is attached via g_timeout_add() in hold_noti().
+ *
+ * @param data the limiter
+ * @return FALSE, so the source is removed
+ */
+static gboolean
+limiter_timeout(gpointer data)
+{
+	struct noti_limiter *lim = data;
+
+	lim->timeout_id = 0;
+	lim->held = FALSE;
+
+	refill_limiter(lim);
+	limiter_send(lim, lim->level, lim->muted);
+
+	return FALSE;
+}
+
+/**
+ * Holds back a notification, to be sent later on by limiter_timeout().
+ * It replaces the one already held back, if any.
+ *
+ * @param lim the limiter
+ * @param level the playback volume level
+ * @param muted whether the playback is muted
+ */
+static void
+hold_noti(struct noti_limiter *lim, gint level, gboolean muted)
+{
+	guint delay;
+
+	if (lim->held)
+		lim->suppressed++;
+
+	lim->held = TRUE;
+	lim->level = level;
+	lim->muted = muted;
+
+	if (settings.noti_policy == NOTI_POLICY_DEFER) {
+		// wait until the source has been quiet for an interval
+		if (lim->timeout_id)
+			g_source_remove(lim->timeout_id);
+		delay = settings.noti_interval;
+	} else {
+		// wait for the next token
+		if (lim->timeout_id)
+			return;
+		delay = (1 - lim->tokens) * settings.noti_interval + 1;
 	}
 
-	g_free(summary);
+	lim->timeout_id = g_timeout_add(delay, limiter_timeout, lim);
+}
+
+/**
+ * Cancels the notifications held back by the limiters.
+ */
+static void
+clear_limiters(void)
+{
+	gint i;
+
+	for (i = 0; i < N_NOTI_SOURCES; i++) {
+		if (limiters[i].timeout_id)
+			g_source_remove(limiters[i].timeout_id);
+		memset(&limiters[i], 0, sizeof(limiters[i]));
+	}
 }
 
 /**
- * Send a text notification.
+ * Clears a slot, dropping its pending notification.
  *
- * @param summary the notification summary
- * @param _body the notification body
+ * @param slot the slot
+ */
+static void
+clear_slot(struct noti_slot *slot)
+{
+	clear_pending_noti(&slot->pending);
+	slot->in_flight = FALSE;
+	slot->id = 0;
+}
+
+/**
+ * Initializes libnotify if it's not already initialized,
+ * and connects to the session bus to send notifications.
  */
 void
-do_notify_text(const gchar *summary, const gchar *body)
+init_libnotify()
 {
-	static NotifyNotification *notification = NULL;
 	GError *error = NULL;
 
-	if (notification == NULL) {
-		notification = NOTIFICATION_NEW("", NULL, NULL);
-		notify_notification_set_timeout(notification, noti_timeout * 2);
-		NOTIFICATION_SET_HINT_STRING(notification,
-					     "x-canonical-private-synchronous", "");
-	}
+	if (!notify_is_initted())
+		if (!notify_init(PACKAGE)) {
+			g_idle_add(idle_report_error, NULL);
+			return;
+		}
 
-	notify_notification_update(notification, summary, body, NULL);
+	if (noti_bus)
+		return;
 
-	if (!notify_notification_show(notification, &error)) {
-		report_error(_("Could not send notification: %s"), error->message);
+	noti_bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+	if (noti_bus == NULL) {
+		g_warning(_("Could not send notification: %s"), error->message);
 		g_error_free(error);
+		return;
+	}
+	noti_cancellable = g_cancellable_new();
+}
+
+/**
+ * Cancels the notifications in flight, drops the ones that
+ * weren't sent yet, and uninitializes libnotify if it is initialized.
+ */
+void
+uninit_libnotify()
+{
+	if (noti_cancellable) {
+		g_cancellable_cancel(noti_cancellable);
+		g_object_unref(noti_cancellable);
+		noti_cancellable = NULL;
+	}
+
+	if (noti_bus) {
+		g_object_unref(noti_bus);
+		noti_bus = NULL;
+	}
+
+	clear_slot(&volume_slot);
+	clear_slot(&text_slot);
+	clear_limiters();
+
+	if (notify_is_initted())
+		notify_uninit();
+}
+
+/**
+ * Send a volume notification. This is mainly called
+ * from the alsa subsystem whenever we have volume
+ * changes. Notifications are rate limited per source, see
+ * struct noti_limiter, so that holding a volume key only
+ * sends a few of them. If EnableOsd is set, the volume is
+ * shown on the built-in OSD instead.
+ *
+ * @param level the playback volume level
+ * @param muted whether the playback is muted
+ * @param source where the change comes from, see enum noti_source
+ */
+void
+do_notify_volume(gint level, gboolean muted, gint source)
+{
+	struct noti_limiter *lim;
+
+	if (!noti_source_enabled(source))
+		return;
+
+	// the OSD is a local redraw, it doesn't need to be rate limited
+	if (settings.osd_enable) {
+		osd_show(level, muted);
+		return;
+	}
+
+	if (settings.noti_interval == 0) {
+		send_volume_noti(level, muted);
+		return;
 	}
+
+	lim = &limiters[source];
+	refill_limiter(lim);
+
+	if (lim->tokens >= 1 && !lim->held) {
+		limiter_send(lim, level, muted);
+		return;
+	}
+
+	if (settings.noti_policy == NOTI_POLICY_DROP) {
+		lim->suppressed++;
+		return;
+	}
+
+	hold_noti(lim, level, muted);
+}
+
+/**
+ * Send a text notification. Like volume notifications, it's
+ * sent asynchronously and coalesced while the daemon is busy.
+ *
+ * @param summary the notification summary
+ * @param body the notification body
+ */
+void
+do_notify_text(const gchar *summary, const gchar *body)
+{
+	struct pending_noti noti = { 0 };
+
+	noti.summary = g_strdup(summary);
+	noti.body = g_strdup(body);
+	noti.level = -1;
+	noti.timeout = noti_timeout * 2;
+
+	queue_noti(&text_slot, &noti);
 }
 
 #else
@@ -184,9 +628,12 @@ uninit_libnotify(void)
 {
 }
 
+// ... except the OSD which doesn't need it
 void
-do_notify_volume(G_GNUC_UNUSED gint level, G_GNUC_UNUSED gboolean muted)
+do_notify_volume(gint level, gboolean muted, gint source)
 {
+	if (settings.osd_enable && noti_source_enabled(source))
+		osd_show(level, muted);
 }
 
 void
@@ -26,9 +26,33 @@
 #include <libnotify/notify.h>
 #endif				// HAVE_LIBN
 
+/**
+ * Where a volume change comes from. Each source has its own
+ * notification preference and rate limit.
+ */
+enum noti_source {
+	NOTI_SOURCE_NONE,	/**< don't send a notification */
+	NOTI_SOURCE_HOTKEY,	/**< volume hotkeys */
+	NOTI_SOURCE_MOUSE,	/**< tray icon, scrolling or middle click */
+	NOTI_SOURCE_POPUP,	/**< slider and mute box of the popup window */
+	NOTI_SOURCE_EXTERNAL,	/**< another application */
+	N_NOTI_SOURCES
+};
+
+/**
+ * What to do with the notifications of a source which is over
+ * its rate limit, see NotificationPolicy.
+ */
+enum noti_policy {
+	NOTI_POLICY_DROP,	/**< don't send them */
+	NOTI_POLICY_MERGE,	/**< send the latest one as soon as allowed */
+	NOTI_POLICY_DEFER,	/**< send the latest one once the source is quiet */
+	N_NOTI_POLICIES
+};
+
 void init_libnotify(void);
 void uninit_libnotify(void);
-void do_notify_volume(gint level, gboolean muted);
+void do_notify_volume(gint level, gboolean muted, gint source);
 void do_notify_text(const gchar *body, const gchar *text);
 
 #endif				// NOTIFY_H_
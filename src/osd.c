@@ -0,0 +1,416 @@
+/* osd.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file osd.c
+ * This file holds the built-in on-screen display, a lightweight
+ * alternative to volume notifications which doesn't need a
+ * notification daemon. It's a popup (override-redirect) window
+ * created once and reused, painting frames rendered once for
+ * each volume level, so that showing a level is a local redraw.
+ * @brief on-screen display
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtk/gtk.h>
+#include <cairo.h>
+
+#include "osd.h"
+#include "prefs.h"
+#include "debug.h"
+
+#define OSD_WIDTH 240
+#define OSD_HEIGHT 48
+#define OSD_RADIUS 10
+#define OSD_PADDING 12
+
+/**
+ * The frame shown when muted, the level doesn't matter then.
+ */
+#define OSD_FRAME_MUTED 101
+
+/**
+ * The OSD window, NULL until the OSD is first needed.
+ */
+static GtkWidget *osd_window = NULL;
+
+/**
+ * Whether the window has an alpha channel, so that it
+ * can have rounded corners.
+ */
+static gboolean osd_rgba;
+
+/**
+ * The rendered frames, one per volume level from 0 to 100 and
+ * one when muted. They are rendered the first time they are shown.
+ */
+static cairo_surface_t *osd_frames[OSD_FRAME_MUTED + 1];
+
+/**
+ * The frame currently shown.
+ */
+static gint osd_frame;
+
+/**
+ * Source id of the timeout hiding the OSD, or 0.
+ */
+static guint osd_hide_id = 0;
+
+/**
+ * The screen of the OSD window and the id of the handler of its
+ * 'composited-changed' signal, or 0.
+ */
+static GdkScreen *osd_screen = NULL;
+static gulong osd_composited_id = 0;
+
+/**
+ * Draws the path of a rectangle with rounded corners.
+ *
+ * @param cr the cairo context
+ * @param x the left of the rectangle
+ * @param y the top of the rectangle
+ * @param w the width of the rectangle
+ * @param h the height of the rectangle
+ * @param r the radius of the corners
+ */
+static void
+rounded_rectangle(cairo_t *cr, double x, double y, double w, double h,
+		  double r)
+{
+	cairo_new_sub_path(cr);
+	cairo_arc(cr, x + w - r, y + r, r, -G_PI / 2, 0);
+	cairo_arc(cr, x + w - r, y + h - r, r, 0, G_PI / 2);
+	cairo_arc(cr, x + r, y + h - r, r, G_PI / 2, G_PI);
+	cairo_arc(cr, x + r, y + r, r, G_PI, 3 * G_PI / 2);
+	cairo_close_path(cr);
+}
+
+/**
+ * Draws a frame of the OSD: a speaker on the left and a bar
+ * filled up to the volume level, or a crossed speaker and an
+ * empty bar when muted.
+ *
+ * @param cr the cairo context, with a cleared target
+ * @param frame the volume level or OSD_FRAME_MUTED
+ */
+static void
+draw_osd_frame(cairo_t *cr, gint frame)
+{
+	double size = OSD_HEIGHT - 2 * OSD_PADDING;
+	double x = OSD_PADDING, y = OSD_PADDING;
+	double bar_x, bar_w, bar_h;
+
+	/* background */
+	if (osd_rgba)
+		rounded_rectangle(cr, 0, 0, OSD_WIDTH, OSD_HEIGHT, OSD_RADIUS);
+	else
+		cairo_rectangle(cr, 0, 0, OSD_WIDTH, OSD_HEIGHT);
+	cairo_set_source_rgba(cr, 0.1, 0.1, 0.1, 0.85);
+	cairo_fill(cr);
+
+	/* speaker */
+	cairo_set_source_rgb(cr, 0.95, 0.95, 0.95);
+	cairo_rectangle(cr, x, y + size / 3, size / 4, size / 3);
+	cairo_move_to(cr, x + size / 4, y + size / 3);
+	cairo_line_to(cr, x + size / 2, y);
+	cairo_line_to(cr, x + size / 2, y + size);
+	cairo_line_to(cr, x + size / 4, y + size * 2 / 3);
+	cairo_close_path(cr);
+	cairo_fill(cr);
+
+	if (frame == OSD_FRAME_MUTED) {
+		cairo_set_line_width(cr, 2);
+		cairo_move_to(cr, x + size * 0.65, y + size * 0.3);
+		cairo_line_to(cr, x + size, y + size * 0.7);
+		cairo_move_to(cr, x + size, y + size * 0.3);
+		cairo_line_to(cr, x + size * 0.65, y + size * 0.7);
+		cairo_stroke(cr);
+	}
+
+	/* bar */
+	bar_x = x + size + OSD_PADDING;
+	bar_w = OSD_WIDTH - bar_x - OSD_PADDING;
+	bar_h = size / 3;
+	y += (size - bar_h) / 2;
+
+	cairo_set_source_rgba(cr, 1, 1, 1, 0.25);
+	cairo_rectangle(cr, bar_x, y, bar_w, bar_h);
+	cairo_fill(cr);
+
+	if (frame != OSD_FRAME_MUTED && frame > 0) {
+		cairo_set_source_rgb(cr, 0.95, 0.95, 0.95);
+		cairo_rectangle(cr, bar_x, y, bar_w * frame / 100, bar_h);
+		cairo_fill(cr);
+	}
+}
+
+/**
+ * Gets a frame of the OSD, rendering it if that's not done yet.
+ *
+ * @param frame the volume level or OSD_FRAME_MUTED
+ * @return the frame, owned by the OSD
+ */
+static cairo_surface_t *
+get_osd_frame(gint frame)
+{
+	cairo_t *cr;
+
+	if (osd_frames[frame])
+		return osd_frames[frame];
+
+	osd_frames[frame] = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+						       OSD_WIDTH, OSD_HEIGHT);
+	cr = cairo_create(osd_frames[frame]);
+	draw_osd_frame(cr, frame);
+	cairo_destroy(cr);
+
+	return osd_frames[frame];
+}
+
+/**
+ * Paints the current frame on the OSD window.
+ *
+ * @param cr the cairo context of the window
+ */
+static void
+paint_osd(cairo_t *cr)
+{
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cr, get_osd_frame(osd_frame), 0, 0);
+	cairo_paint(cr);
+}
+
+#ifdef WITH_GTK3
+/**
+ * Handler for the signal 'draw' on the OSD window.
+ *
+ * @param widget the object which received the signal
+ * @param cr the cairo context to draw to
+ * @param user_data user data set when the signal handler was connected
+ * @return TRUE to stop other handlers from being invoked for the event
+ */
+static gboolean
+on_osd_draw(G_GNUC_UNUSED GtkWidget *widget, cairo_t *cr,
+	    G_GNUC_UNUSED gpointer user_data)
+{
+	paint_osd(cr);
+	return TRUE;
+}
+#else
+/**
+ * Handler for the signal 'expose-event' on the OSD window.
+ *
+ * @param widget the object which received the signal
+ * @param event the GdkEventExpose which triggered this signal
+ * @param user_data user data set when the signal handler was connected
+ * @return TRUE to stop other handlers from being invoked for the event
+ */
+static gboolean
+on_osd_expose(GtkWidget *widget, G_GNUC_UNUSED GdkEventExpose *event,
+	      G_GNUC_UNUSED gpointer user_data)
+{
+	cairo_t *cr = gdk_cairo_create(gtk_widget_get_window(widget));
+
+	paint_osd(cr);
+	cairo_destroy(cr);
+	return TRUE;
+}
+#endif
+
+/**
+ * Creates the OSD window, with an alpha channel if the screen
+ * supports it.
+ */
+static void
+create_osd_window(void)
+{
+	GdkScreen *screen;
+
+	osd_window = gtk_window_new(GTK_WINDOW_POPUP);
+	gtk_window_set_default_size(GTK_WINDOW(osd_window),
+				    OSD_WIDTH, OSD_HEIGHT);
+	gtk_window_set_accept_focus(GTK_WINDOW(osd_window), FALSE);
+	gtk_widget_set_app_paintable(osd_window, TRUE);
+
+	screen = gtk_widget_get_screen(osd_window);
+	osd_rgba = gdk_screen_is_composited(screen);
+#ifdef WITH_GTK3
+	if (osd_rgba && gdk_screen_get_rgba_visual(screen))
+		gtk_widget_set_visual(osd_window,
+				      gdk_screen_get_rgba_visual(screen));
+	else
+		osd_rgba = FALSE;
+
+	g_signal_connect(osd_window, "draw", G_CALLBACK(on_osd_draw), NULL);
+#else
+	if (osd_rgba && gdk_screen_get_rgba_colormap(screen))
+		gtk_widget_set_colormap(osd_window,
+					gdk_screen_get_rgba_colormap(screen));
+	else
+		osd_rgba = FALSE;
+
+	g_signal_connect(osd_window, "expose-event",
+			 G_CALLBACK(on_osd_expose), NULL);
+#endif
+
+	DEBUG_PRINT("OSD created, %s alpha channel",
+		    osd_rgba ? "with" : "without");
+}
+
+/**
+ * Frees the rendered frames, so that they are rendered again
+ * the next time they are shown.
+ */
+static void
+free_osd_frames(void)
+{
+	gint i;
+
+	for (i = 0; i <= OSD_FRAME_MUTED; i++) {
+		if (osd_frames[i])
+			cairo_surface_destroy(osd_frames[i]);
+		osd_frames[i] = NULL;
+	}
+}
+
+/**
+ * Handler for the signal 'composited-changed' on the screen of the
+ * OSD window. The visual and the shape of the frames depend on
+ * whether the screen is composited, so the window is created
+ * again, at the same place if it's shown, and the frames dropped.
+ *
+ * @param screen the object which received the signal
+ * @param user_data user data set when the signal handler was connected
+ */
+static void
+on_osd_composited_changed(G_GNUC_UNUSED GdkScreen *screen,
+			  G_GNUC_UNUSED gpointer user_data)
+{
+	gboolean visible;
+	gint x, y;
+
+	if (osd_window == NULL)
+		return;
+
+	visible = gtk_widget_get_visible(osd_window);
+	gtk_window_get_position(GTK_WINDOW(osd_window), &x, &y);
+
+	gtk_widget_destroy(osd_window);
+	free_osd_frames();
+	create_osd_window();
+
+	if (visible) {
+		gtk_window_move(GTK_WINDOW(osd_window), x, y);
+		gtk_widget_show(osd_window);
+	}
+}
+
+/**
+ * Creates the OSD window and follows the compositing changes
+ * of its screen. Does nothing if it's already created.
+ */
+void
+osd_init(void)
+{
+	if (osd_window)
+		return;
+
+	create_osd_window();
+
+	osd_screen = gtk_widget_get_screen(osd_window);
+	osd_composited_id = g_signal_connect(osd_screen, "composited-changed",
+					     G_CALLBACK
+					     (on_osd_composited_changed), NULL);
+}
+
+/**
+ * Hides the OSD.
+ * This function is attached via g_timeout_add() in osd_show().
+ *
+ * @param data unused
+ * @return FALSE, so the source is removed
+ */
+static gboolean
+osd_hide_timeout(G_GNUC_UNUSED gpointer data)
+{
+	osd_hide_id = 0;
+	gtk_widget_hide(osd_window);
+
+	return FALSE;
+}
+
+/**
+ * Shows the volume on the OSD, at the bottom of the primary monitor,
+ * for NotificationTimeout ms. If it's already shown, only the level
+ * is redrawn and the timeout restarted.
+ *
+ * @param level the playback volume level
+ * @param muted whether the playback is muted
+ */
+void
+osd_show(gint level, gboolean muted)
+{
+	gint frame = muted ? OSD_FRAME_MUTED : CLAMP(level, 0, 100);
+	GdkScreen *screen;
+	GdkRectangle geom;
+
+	osd_init();
+
+	if (osd_hide_id)
+		g_source_remove(osd_hide_id);
+	osd_hide_id = g_timeout_add(noti_timeout, osd_hide_timeout, NULL);
+
+	if (gtk_widget_get_visible(osd_window)) {
+		if (frame != osd_frame) {
+			osd_frame = frame;
+			gtk_widget_queue_draw(osd_window);
+		}
+		return;
+	}
+
+	screen = gtk_widget_get_screen(osd_window);
+	gdk_screen_get_monitor_geometry(screen,
+					gdk_screen_get_primary_monitor(screen),
+					&geom);
+	gtk_window_move(GTK_WINDOW(osd_window),
+			geom.x + (geom.width - OSD_WIDTH) / 2,
+			geom.y + geom.height * 4 / 5);
+
+	osd_frame = frame;
+	gtk_widget_show(osd_window);
+}
+
+/**
+ * Destroys the OSD window and frees the frames.
+ */
+void
+osd_free(void)
+{
+	if (osd_hide_id) {
+		g_source_remove(osd_hide_id);
+		osd_hide_id = 0;
+	}
+
+	if (osd_composited_id) {
+		g_signal_handler_disconnect(osd_screen, osd_composited_id);
+		osd_composited_id = 0;
+		osd_screen = NULL;
+	}
+
+	if (osd_window) {
+		gtk_widget_destroy(osd_window);
+		osd_window = NULL;
+	}
+
+	free_osd_frames();
+}
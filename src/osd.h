@@ -0,0 +1,26 @@
+/* osd.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file osd.h
+ * Header for osd.c.
+ * @brief header for osd.c
+ */
+
+#ifndef OSD_H_
+#define OSD_H_
+
+#include <glib.h>
+
+void osd_init(void);
+void osd_show(gint level, gboolean muted);
+void osd_free(void);
+
+#endif				// OSD_H_
@@ -31,6 +31,7 @@
 
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <gio/gio.h>
 #include <gdk/gdkkeysyms.h>
 #include <gdk/gdkx.h>
 #include <X11/XKBlib.h>
@@ -41,6 +42,7 @@
 #include "support.h"
 #include "main.h"
 #include "hotkeys.h"
+#include "notify.h"
 #include "debug.h"
 
 #ifdef WITH_GTK3
@@ -64,8 +66,148 @@ VolDownKey=-1\n\
 AlsaCard=default\n\
 SystemTheme=false"
 
+/**
+ * Default rate (in Hz) at which external volume changes are
+ * propagated to the UI, see ExternalRefreshRate.
+ */
+#define DEFAULT_EXTERNAL_REFRESH_RATE 60
+
+/**
+ * Default maximum number of hardware writes per second while
+ * dragging the volume slider, see SliderWriteRate.
+ */
+#define DEFAULT_SLIDER_WRITE_RATE 30
+
+/**
+ * Default minimum interval (in ms) between the volume notifications
+ * of a source, once its burst is used up, see NotificationInterval.
+ */
+#define DEFAULT_NOTIFICATION_INTERVAL 250
+
+/**
+ * Default number of volume notifications a source can send in a row
+ * before being limited, see NotificationBurst.
+ */
+#define DEFAULT_NOTIFICATION_BURST 2
+
+/**
+ * How long (in ms) to wait after the last change of the config
+ * file before reloading it. Editors and configuration management
+ * tools usually write the file in several steps.
+ */
+#define RELOAD_DELAY 200
+
+/**
+ * How long (in ms) to wait for further changes before writing
+ * the preferences to disk, so that a burst of saves causes
+ * only one write.
+ */
+#define SAVE_DELAY 500
+
+/**
+ * The subsystems which may be affected by a change of the preferences,
+ * as a bitmask. Used to only apply what actually changed when the
+ * config file is reloaded.
+ */
+enum prefs_change {
+	PREFS_CHANGE_SCROLL = 1 << 0,	/**< scroll steps of the slider */
+	PREFS_CHANGE_HOTKEYS = 1 << 1,	/**< hotkeys, need a regrab */
+	PREFS_CHANGE_NOTIFICATIONS = 1 << 2,	/**< notification options */
+	PREFS_CHANGE_ICONS = 1 << 3,	/**< status icons and volume meter */
+	PREFS_CHANGE_VOL_TEXT = 1 << 4,	/**< volume text of the popup */
+	PREFS_CHANGE_VOLUME = 1 << 5,	/**< how the volume is shown */
+	PREFS_CHANGE_GROUP = 1 << 6,	/**< volume group, needs a rebuild */
+	PREFS_CHANGE_MIXER_POOL = 1 << 7,	/**< size of the mixer pool */
+	PREFS_CHANGE_ALL = (1 << 8) - 1
+};
+
+/**
+ * Maps a key of the [PNMixer] group to the subsystems it affects.
+ * Keys not listed here are either read on demand or only cached
+ * in the settings struct, so they don't need anything to be applied.
+ */
+static const struct {
+	const gchar *key;
+	guint change;
+} prefs_changes[] = {
+	{ "ScrollStep", PREFS_CHANGE_SCROLL },
+	{ "FineScrollStep", PREFS_CHANGE_SCROLL },
+	{ "EnableHotKeys", PREFS_CHANGE_HOTKEYS },
+	{ "VolMuteKey", PREFS_CHANGE_HOTKEYS },
+	{ "VolUpKey", PREFS_CHANGE_HOTKEYS },
+	{ "VolDownKey", PREFS_CHANGE_HOTKEYS },
+	{ "VolMuteMods", PREFS_CHANGE_HOTKEYS },
+	{ "VolUpMods", PREFS_CHANGE_HOTKEYS },
+	{ "VolDownMods", PREFS_CHANGE_HOTKEYS },
+	{ "HotkeyVolumeStep", PREFS_CHANGE_HOTKEYS },
+	{ "ExtraHotkeys", PREFS_CHANGE_HOTKEYS },
+	{ "EnableNotifications", PREFS_CHANGE_NOTIFICATIONS },
+	{ "HotkeyNotifications", PREFS_CHANGE_NOTIFICATIONS },
+	{ "MouseNotifications", PREFS_CHANGE_NOTIFICATIONS },
+	{ "PopupNotifications", PREFS_CHANGE_NOTIFICATIONS },
+	{ "ExternalNotifications", PREFS_CHANGE_NOTIFICATIONS },
+	{ "NotificationTimeout", PREFS_CHANGE_NOTIFICATIONS },
+	{ "SystemTheme", PREFS_CHANGE_ICONS },
+	{ "DrawVolMeter", PREFS_CHANGE_ICONS },
+	{ "VolMeterPos", PREFS_CHANGE_ICONS },
+	{ "VolMeterColor", PREFS_CHANGE_ICONS },
+	{ "VolMeterStyle", PREFS_CHANGE_ICONS },
+	{ "DisplayTextVolume", PREFS_CHANGE_VOL_TEXT },
+	{ "TextVolumePosition", PREFS_CHANGE_VOL_TEXT },
+	{ "NormalizeVolume", PREFS_CHANGE_VOLUME },
+	{ "VolumeGroup", PREFS_CHANGE_GROUP },
+	{ "MixerPoolSize", PREFS_CHANGE_MIXER_POOL },
+};
+
 static GKeyFile *keyFile;
 
+struct settings settings;
+
+/**
+ * Watch on the config file, to pick up changes made outside
+ * of the preferences window.
+ */
+static GFileMonitor *prefs_monitor = NULL;
+
+/**
+ * Source id of the pending reload of the config file, or 0.
+ */
+static guint reload_id = 0;
+
+/**
+ * Writer thread of the config file, so that a slow filesystem
+ * doesn't block the GTK thread.
+ */
+static GThreadPool *save_pool = NULL;
+
+/**
+ * Protects save_data and save_len, which are shared
+ * with the writer thread.
+ */
+static GMutex save_lock;
+
+/**
+ * The serialized preferences waiting to be written, or NULL.
+ * Only the latest ones are kept.
+ */
+static gchar *save_data = NULL;
+
+/**
+ * Length of save_data.
+ */
+static gsize save_len;
+
+/**
+ * Source id of the pending (debounced) save, or 0.
+ */
+static guint save_id = 0;
+
+/**
+ * Number of writes queued on save_pool which didn't report
+ * back to the main loop yet.
+ */
+static guint saves_in_flight = 0;
+
 /**
  * Gets a boolean value from preferences.
  * On error, returns def as default value.
@@ -167,6 +309,30 @@ prefs_get_channel(const gchar *card)
 	return g_key_file_get_string(keyFile, card, "Channel", NULL);
 }
 
+/**
+ * Gets the members of a volume group from the global keyFile. They
+ * are listed in the Members entry of the group '[Group <name>]',
+ * in the form 'card:channel'.
+ *
+ * @param group the name of the volume group
+ * @return NULL-terminated array of members, NULL on failure.
+ * Must be freed with g_strfreev().
+ */
+gchar **
+prefs_get_group_members(const gchar *group)
+{
+	gchar *group_name, **ret;
+
+	if (!group)
+		return NULL;
+
+	group_name = g_strdup_printf("Group %s", group);
+	ret = g_key_file_get_string_list(keyFile, group_name, "Members",
+					 NULL, NULL);
+	g_free(group_name);
+
+	return ret;
+}
 
 /**
  * Default volume commands.
@@ -179,6 +345,53 @@ static const gchar *vol_commands[] = {
 	NULL
 };
 
+/**
+ * The first of vol_commands found in PATH, or NULL,
+ * see find_default_vol_command().
+ */
+static const gchar *default_vol_command = NULL;
+
+/**
+ * The value of PATH when default_vol_command was looked up.
+ */
+static gchar *default_vol_command_path = NULL;
+
+/**
+ * Looks for the first of vol_commands which is in PATH. This is done
+ * in-process and the result is cached until PATH changes. If none was
+ * found, the lookup is done again next time, in case one was installed
+ * in the meantime.
+ *
+ * @return the command, or NULL if none is installed
+ */
+static const gchar *
+find_default_vol_command(void)
+{
+	const gchar *path = g_getenv("PATH");
+	const gchar **cmd;
+
+	if (default_vol_command &&
+	    !g_strcmp0(path, default_vol_command_path))
+		return default_vol_command;
+
+	g_free(default_vol_command_path);
+	default_vol_command_path = g_strdup(path);
+	default_vol_command = NULL;
+
+	for (cmd = vol_commands; *cmd; cmd++) {
+		gchar *program = g_find_program_in_path(*cmd);
+
+		if (program) {
+			DEBUG_PRINT("Found volume command '%s'", program);
+			g_free(program);
+			default_vol_command = *cmd;
+			break;
+		}
+	}
+
+	return default_vol_command;
+}
+
 /**
  * Gets the current volume command from the user preferences
  * and returns it. If none is set, iterates through the list vol_commands to
@@ -194,16 +407,8 @@ prefs_get_vol_command(void)
 
 	ret = prefs_get_string("VolumeControlCommand", NULL);
 
-	if (ret == NULL) {
-		gchar buf[256];
-		const char **cmd = vol_commands;
-		while (*cmd) {
-			snprintf(buf, 256, "which %s | grep /%s > /dev/null", *cmd, *cmd);
-			if (!system(buf))
-				return g_strdup(*cmd);
-			cmd++;
-		}
-	}
+	if (ret == NULL)
+		ret = g_strdup(find_default_vol_command());
 
 	return ret;
 }
@@ -316,6 +521,76 @@ prefs_set_vol_meter_colors(gdouble *colors, gsize n)
 	g_key_file_set_double_list(keyFile, "PNMixer", "VolMeterColor", colors, n);
 }
 
+/**
+ * Gets a rate (in Hz) from preferences, between 1 and 1000.
+ *
+ * @param key the specific settings key
+ * @param def the default value, used if the preference is not set
+ * or not valid
+ * @return the rate
+ */
+static gint
+prefs_get_rate(gchar *key, gint def)
+{
+	gint rate = prefs_get_integer(key, def);
+
+	if (rate <= 0)
+		return def;
+	return MIN(rate, 1000);
+}
+
+/**
+ * Parses the keyFile into the settings struct and bumps
+ * its generation.
+ */
+static void
+parse_settings(void)
+{
+	if (keyFile == NULL)
+		return;
+
+	settings.normalize_volume = prefs_get_boolean("NormalizeVolume", FALSE);
+	settings.ramp_duration = MAX(prefs_get_integer("RampDuration", 0), 0);
+	settings.slider_write_rate = prefs_get_rate("SliderWriteRate",
+				     DEFAULT_SLIDER_WRITE_RATE);
+	settings.external_refresh_rate = prefs_get_rate("ExternalRefreshRate",
+					 DEFAULT_EXTERNAL_REFRESH_RATE);
+	settings.mixer_pool_size = MAX(prefs_get_integer("MixerPoolSize", 0), 0);
+
+	settings.noti_interval = MAX(prefs_get_integer("NotificationInterval",
+				     DEFAULT_NOTIFICATION_INTERVAL), 0);
+	settings.noti_burst = MAX(prefs_get_integer("NotificationBurst",
+				  DEFAULT_NOTIFICATION_BURST), 1);
+	settings.noti_policy = prefs_get_integer("NotificationPolicy",
+			       NOTI_POLICY_MERGE);
+	if (settings.noti_policy < 0 || settings.noti_policy >= N_NOTI_POLICIES)
+		settings.noti_policy = NOTI_POLICY_MERGE;
+	settings.osd_enable = prefs_get_boolean("EnableOsd", FALSE);
+
+	settings.middle_click_action = prefs_get_integer("MiddleClickAction", 0);
+	g_free(settings.custom_command);
+	settings.custom_command = prefs_get_string("CustomCommand", NULL);
+
+	settings.system_theme = prefs_get_boolean("SystemTheme", FALSE);
+	settings.draw_vol_meter = prefs_get_boolean("DrawVolMeter", FALSE);
+	settings.vol_meter_style = prefs_get_integer("VolMeterStyle", 0);
+	settings.vol_meter_pos = prefs_get_integer("VolMeterPos", 0);
+
+	settings.generation++;
+}
+
+/**
+ * Gets the path of the config file.
+ *
+ * @return the path, must be freed
+ */
+static gchar *
+get_prefs_filename(void)
+{
+	return g_build_filename(g_get_user_config_dir(),
+				"pnmixer", "config", NULL);
+}
+
 /**
  * Loads the preferences from the config file to the keyFile object (GKeyFile type).
  * Creates the keyFile object if it doesn't exist.
@@ -324,8 +599,7 @@ void
 prefs_load(void)
 {
 	GError *err = NULL;
-	gchar *filename = g_build_filename(g_get_user_config_dir(),
-	                                   "pnmixer", "config", NULL);
+	gchar *filename = get_prefs_filename();
 
 	if (keyFile != NULL)
 		g_key_file_free(keyFile);
@@ -352,29 +626,155 @@ prefs_load(void)
 	}
 
 	g_free(filename);
+
+	parse_settings();
+}
+
+/**
+ * Writes the latest serialized preferences to the config file.
+ * g_file_set_contents() writes to a temporary file which is then
+ * renamed, so the config file is never seen half-written.
+ *
+ * @param err return location for an error
+ * @return TRUE on success or if there was nothing to write
+ */
+static gboolean
+write_save_data(GError **err)
+{
+	gchar *filename;
+	gchar *filedata;
+	gsize len;
+	gboolean ret;
+
+	g_mutex_lock(&save_lock);
+	filedata = save_data;
+	len = save_len;
+	save_data = NULL;
+	g_mutex_unlock(&save_lock);
+
+	if (filedata == NULL)
+		return TRUE;
+
+	filename = get_prefs_filename();
+	ret = g_file_set_contents(filename, filedata, len, err);
+
+	g_free(filename);
+	g_free(filedata);
+
+	return ret;
+}
+
+/**
+ * Reports the end of a write of the config file, and its error
+ * if any, in the GTK thread.
+ * This function is attached via g_idle_add() in save_func().
+ *
+ * @param data the error message, or NULL
+ * @return FALSE, so the source is removed
+ */
+static gboolean
+idle_save_done(gpointer data)
+{
+	gchar *msg = data;
+
+	saves_in_flight--;
+
+	if (msg) {
+		report_error(_("Couldn't write preferences file: %s"), msg);
+		g_free(msg);
+	}
+
+	return FALSE;
+}
+
+/**
+ * Writes the config file. This runs in the thread of save_pool.
+ *
+ * @param data unused
+ * @param user_data unused
+ */
+static void
+save_func(G_GNUC_UNUSED gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+	GError *err = NULL;
+	gchar *msg = NULL;
+
+	if (!write_save_data(&err)) {
+		msg = g_strdup(err->message);
+		g_error_free(err);
+	}
+
+	g_idle_add(idle_save_done, msg);
+}
+
+/**
+ * Hands the pending preferences over to the writer thread.
+ * This function is attached via g_timeout_add() in prefs_save().
+ *
+ * @param data unused
+ * @return FALSE, so the source is removed
+ */
+static gboolean
+save_timeout(G_GNUC_UNUSED gpointer data)
+{
+	save_id = 0;
+
+	if (save_pool == NULL)
+		save_pool = g_thread_pool_new(save_func, NULL, 1, FALSE, NULL);
+
+	saves_in_flight++;
+	g_thread_pool_push(save_pool, GINT_TO_POINTER(TRUE), NULL);
+
+	return FALSE;
 }
 
 /**
  * Save the preferences from the keyFile object to the config file.
+ * The preferences are serialized right away, but written later on
+ * by a writer thread, after a short delay to group bursts of saves.
+ * Errors are reported from the main loop.
  */
 void
 prefs_save(void)
 {
 	gsize len;
-	GError *err = NULL;
-	gchar *filename = g_build_filename(g_get_user_config_dir(),
-	                                   "pnmixer", "config", NULL);
 	gchar *filedata = g_key_file_to_data(keyFile, &len, NULL);
 
-	g_file_set_contents(filename, filedata, len, &err);
+	g_mutex_lock(&save_lock);
+	g_free(save_data);
+	save_data = filedata;
+	save_len = len;
+	g_mutex_unlock(&save_lock);
 
-	if (err != NULL) {
-		report_error(_("Couldn't write preferences file: %s"), err->message);
-		g_error_free(err);
+	if (save_id)
+		g_source_remove(save_id);
+	save_id = g_timeout_add(SAVE_DELAY, save_timeout, NULL);
+}
+
+/**
+ * Writes the pending preferences, if any, and waits for the writer
+ * thread to be done. To be called before exiting.
+ */
+void
+prefs_flush(void)
+{
+	GError *err = NULL;
+
+	if (save_id) {
+		g_source_remove(save_id);
+		save_id = 0;
 	}
 
-	g_free(filename);
-	g_free(filedata);
+	if (save_pool) {
+		g_thread_pool_free(save_pool, FALSE, TRUE);
+		save_pool = NULL;
+	}
+
+	if (!write_save_data(&err)) {
+		report_error(_("Couldn't write preferences file: %s"),
+			     err->message);
+		g_error_free(err);
+	}
 }
 
 /**
@@ -417,49 +817,451 @@ set_notification_options(void)
 	noti_timeout = prefs_get_integer("NotificationTimeout", 1500);
 }
 
+/**
+ * Binds a hotkey of the ExtraHotkeys preference, written as
+ * 'accelerator:action[:step]', the action being one of 'mute',
+ * 'up', 'down' or 'next-card'.
+ *
+ * @param spec the hotkey
+ */
+static void
+bind_extra_hotkey(const gchar *spec)
+{
+	gchar **fields = g_strsplit(spec, ":", 3);
+	guint keysym;
+	GdkModifierType mods;
+	gint keycode, step = 0, action = HOTKEY_NONE;
+
+	if (g_strv_length(fields) < 2)
+		goto out;
+
+	gtk_accelerator_parse(fields[0], &keysym, &mods);
+	if (keysym == 0)
+		goto out;
+	keycode = XKeysymToKeycode(gdk_x11_get_default_xdisplay(), keysym);
+	if (keycode == 0) {
+		g_warning("No keycode for the key of hotkey '%s'", spec);
+		g_strfreev(fields);
+		return;
+	}
+
+	if (fields[2])
+		step = atoi(fields[2]);
+	if (step <= 0)
+		step = prefs_get_integer("HotkeyVolumeStep", 1);
+
+	if (!strcmp(fields[1], "mute")) {
+		action = HOTKEY_MUTE;
+	} else if (!strcmp(fields[1], "up")) {
+		action = HOTKEY_VOLUME;
+	} else if (!strcmp(fields[1], "down")) {
+		action = HOTKEY_VOLUME;
+		step = -step;
+	} else if (!strcmp(fields[1], "next-card")) {
+		action = HOTKEY_NEXT_CARD;
+	}
+
+	if (action != HOTKEY_NONE)
+		bind_hotkey(keycode, mods, action, step);
+
+out:
+	if (action == HOTKEY_NONE)
+		g_warning("Invalid hotkey '%s'", spec);
+	g_strfreev(fields);
+}
+
+/**
+ * Grabs the hotkeys set in the user settings, or ungrabs
+ * them if hotkeys are disabled.
+ */
+static void
+set_hotkeys(void)
+{
+	gint hstep;
+	gchar **extra, **spec;
+
+	unbind_hotkeys();
+
+	if (!prefs_get_boolean("EnableHotKeys", FALSE))
+		return;
+
+	hstep = prefs_get_integer("HotkeyVolumeStep", 1);
+	bind_hotkey(prefs_get_integer("VolMuteKey", -1),
+		    prefs_get_integer("VolMuteMods", 0), HOTKEY_MUTE, 0);
+	bind_hotkey(prefs_get_integer("VolUpKey", -1),
+		    prefs_get_integer("VolUpMods", 0), HOTKEY_VOLUME, hstep);
+	bind_hotkey(prefs_get_integer("VolDownKey", -1),
+		    prefs_get_integer("VolDownMods", 0), HOTKEY_VOLUME, -hstep);
+
+	extra = g_key_file_get_string_list(keyFile, "PNMixer", "ExtraHotkeys",
+					   NULL, NULL);
+	if (extra) {
+		for (spec = extra; *spec; spec++)
+			bind_extra_hotkey(*spec);
+		g_strfreev(extra);
+	}
+
+	grab_hotkeys();
+}
+
+/**
+ * Applies the preferences to the given subsystems.
+ *
+ * @param changes the subsystems to update, see enum prefs_change
+ * @param alsa_change what changed in the alsa settings, see enum alsa_change
+ */
+static void
+apply_prefs_changes(guint changes, gint alsa_change)
+{
+	parse_settings();
+
+	if (changes & PREFS_CHANGE_SCROLL) {
+		scroll_step = prefs_get_integer("ScrollStep", 5);
+		gtk_adjustment_set_page_increment(vol_adjustment, scroll_step);
+
+		fine_scroll_step = prefs_get_integer("FineScrollStep", 1);
+		gtk_adjustment_set_step_increment(vol_adjustment,
+						  fine_scroll_step);
+	}
+
+	if (changes & PREFS_CHANGE_HOTKEYS)
+		set_hotkeys();
+
+	if (changes & PREFS_CHANGE_NOTIFICATIONS)
+		set_notification_options();
+
+	if (changes & PREFS_CHANGE_ICONS) {
+		gdouble *vol_meter_clrs;
+
+		vol_meter_clrs = prefs_get_vol_meter_colors();
+		set_vol_meter_color(vol_meter_clrs[0], vol_meter_clrs[1],
+				    vol_meter_clrs[2]);
+		g_free(vol_meter_clrs);
+
+		update_status_icons();
+	}
+
+	if (changes & PREFS_CHANGE_VOL_TEXT)
+		update_vol_text();
+
+	if (changes & PREFS_CHANGE_MIXER_POOL)
+		alsa_trim_mixer_pool();
+
+	// binding a card or a channel builds the volume group too
+	if (alsa_change == ALSA_CHANGE_REINIT)
+		do_alsa_reinit();
+	else if (alsa_change == ALSA_CHANGE_CARD)
+		do_alsa_card_change();
+	else if (alsa_change == ALSA_CHANGE_CHANNEL)
+		do_alsa_channel_change();
+	else {
+		if (changes & PREFS_CHANGE_GROUP)
+			alsa_rebuild_group();
+		if (changes & PREFS_CHANGE_VOLUME)
+			on_volume_has_changed();
+	}
+}
+
 /**
  * Applies the preferences, usually triggered by on_ok_button_clicked()
  * in callbacks.c, but also initially called from main().
  *
- * @param alsa_change whether we want to trigger alsa-reinitalization
+ * @param alsa_change what changed in the alsa settings, see enum alsa_change
  */
 void
 apply_prefs(gint alsa_change)
 {
-	gdouble *vol_meter_clrs;
+	// the volume groups can't be edited in the dialog, and
+	// binding the card at startup builds the group already
+	apply_prefs_changes(PREFS_CHANGE_ALL & ~PREFS_CHANGE_GROUP,
+			    alsa_change);
+}
 
-	scroll_step = prefs_get_integer("ScrollStep", 5);
-	gtk_adjustment_set_page_increment(vol_adjustment, scroll_step);
-
-	fine_scroll_step = prefs_get_integer("FineScrollStep", 1);
-	gtk_adjustment_set_step_increment(vol_adjustment, fine_scroll_step);
-
-	if (prefs_get_boolean("EnableHotKeys", FALSE)) {
-		gint mk, uk, dk, mm, um, dm, hstep;
-		mk = prefs_get_integer("VolMuteKey", -1);
-		uk = prefs_get_integer("VolUpKey", -1);
-		dk = prefs_get_integer("VolDownKey", -1);
-		mm = prefs_get_integer("VolMuteMods", 0);
-		um = prefs_get_integer("VolUpMods", 0);
-		dm = prefs_get_integer("VolDownMods", 0);
-		hstep = prefs_get_integer("HotkeyVolumeStep", 1);
-		grab_keys(mk, uk, dk, mm, um, dm, hstep);
-	} else
-		// will actually just ungrab everything
-		grab_keys(-1, -1, -1, 0, 0, 0, 1);
+/**
+ * Gets the subsystems affected by a key of the [PNMixer] group.
+ *
+ * @param key the key
+ * @return the subsystems, see enum prefs_change
+ */
+static guint
+get_key_change(const gchar *key)
+{
+	gsize i;
 
-	set_notification_options();
+	for (i = 0; i < G_N_ELEMENTS(prefs_changes); i++)
+		if (!strcmp(prefs_changes[i].key, key))
+			return prefs_changes[i].change;
 
-	vol_meter_clrs = prefs_get_vol_meter_colors();
-	set_vol_meter_color(vol_meter_clrs[0], vol_meter_clrs[1],
-			    vol_meter_clrs[2]);
-	g_free(vol_meter_clrs);
+	return 0;
+}
+
+/**
+ * Gets the keys of a group of both key files that have a different
+ * value in each of them, including keys only present in one of them.
+ *
+ * @param old the old key file
+ * @param new the new key file
+ * @param group the group to compare
+ * @return list of the keys that differ, must be freed with
+ * g_slist_free_full(list, g_free)
+ */
+static GSList *
+diff_group(GKeyFile *old, GKeyFile *new, const gchar *group)
+{
+	GKeyFile *files[2] = { old, new };
+	GSList *changed = NULL;
+	gint i;
 
-	update_status_icons();
-	update_vol_text();
+	for (i = 0; i < 2; i++) {
+		gchar **keys;
+		gchar **key;
 
-	if (alsa_change)
-		do_alsa_reinit();
+		keys = g_key_file_get_keys(files[i], group, NULL, NULL);
+		if (keys == NULL)
+			continue;
+
+		for (key = keys; *key; key++) {
+			gchar *a, *b;
+
+			/* keys present in both files are handled once */
+			if (i == 1 && g_key_file_has_key(old, group, *key, NULL))
+				continue;
+
+			a = g_key_file_get_value(old, group, *key, NULL);
+			b = g_key_file_get_value(new, group, *key, NULL);
+			if (g_strcmp0(a, b))
+				changed = g_slist_prepend(changed, g_strdup(*key));
+			g_free(a);
+			g_free(b);
+		}
+
+		g_strfreev(keys);
+	}
+
+	return changed;
+}
+
+/**
+ * Works out which subsystems are affected by the differences
+ * of a group of two key files.
+ *
+ * @param old the old key file
+ * @param new the new key file
+ * @param group the group to compare
+ * @param card_name the card set in the new key file, or NULL
+ * @param alsa_change location of what changed in the alsa settings
+ * so far, see enum alsa_change, updated if needed
+ * @return the subsystems to update, see enum prefs_change
+ */
+static guint
+diff_prefs_group(GKeyFile *old, GKeyFile *new, const gchar *group,
+		 const gchar *card_name, gint *alsa_change)
+{
+	struct acard *active = alsa_get_active_card();
+	GSList *keys = diff_group(old, new, group);
+	GSList *item;
+	guint changes = 0;
+
+	for (item = keys; item; item = item->next) {
+		const gchar *key = item->data;
+
+		DEBUG_PRINT("Preference [%s] %s changed", group, key);
+
+		if (!strcmp(group, "PNMixer")) {
+			if (!strcmp(key, "AlsaCard"))
+				*alsa_change = ALSA_CHANGE_CARD;
+			else
+				changes |= get_key_change(key);
+		} else if (g_str_has_prefix(group, "Group ")) {
+			changes |= PREFS_CHANGE_GROUP;
+		} else if (!strcmp(key, "Channel") &&
+			   (!g_strcmp0(group, card_name) ||
+			    (active && !strcmp(group, active->name)))) {
+			if (*alsa_change == ALSA_CHANGE_NONE)
+				*alsa_change = ALSA_CHANGE_CHANNEL;
+		}
+	}
+
+	g_slist_free_full(keys, g_free);
+
+	return changes;
+}
+
+/**
+ * Compares two key files and works out which subsystems are
+ * affected by the difference.
+ *
+ * @param old the old key file
+ * @param new the new key file
+ * @param alsa_change return location for what changed in the
+ * alsa settings, see enum alsa_change
+ * @return the subsystems to update, see enum prefs_change
+ */
+static guint
+diff_prefs(GKeyFile *old, GKeyFile *new, gint *alsa_change)
+{
+	gchar **groups, **group;
+	gchar *card_name;
+	guint changes = 0;
+
+	*alsa_change = ALSA_CHANGE_NONE;
+	card_name = g_key_file_get_string(new, "PNMixer", "AlsaCard", NULL);
+
+	groups = g_key_file_get_groups(old, NULL);
+	for (group = groups; *group; group++)
+		changes |= diff_prefs_group(old, new, *group, card_name,
+					    alsa_change);
+	g_strfreev(groups);
+
+	// groups that only exist in the new file
+	groups = g_key_file_get_groups(new, NULL);
+	for (group = groups; *group; group++)
+		if (!g_key_file_has_group(old, *group))
+			changes |= diff_prefs_group(old, new, *group, card_name,
+						    alsa_change);
+	g_strfreev(groups);
+
+	g_free(card_name);
+
+	return changes;
+}
+
+/**
+ * Reloads the config file after it changed on disk, and applies
+ * the preferences that differ from the ones in use. If the file
+ * is gone or can't be parsed, the current preferences are kept.
+ *
+ * @param data user data set when the source was added
+ * @return FALSE, so the source is removed
+ */
+static gboolean
+reload_prefs(G_GNUC_UNUSED gpointer data)
+{
+	GKeyFile *new;
+	GError *err = NULL;
+	gchar *filename;
+	guint changes;
+	gint alsa_change;
+
+	reload_id = 0;
+
+	// the file is about to be written with the preferences in use,
+	// wait for it instead of reading what's on disk now
+	if (save_id || saves_in_flight) {
+		reload_id = g_timeout_add(RELOAD_DELAY, reload_prefs, NULL);
+		return FALSE;
+	}
+
+	filename = get_prefs_filename();
+	new = g_key_file_new();
+	if (!g_key_file_load_from_file(new, filename, 0, &err)) {
+		DEBUG_PRINT("Not reloading preferences: %s", err->message);
+		g_error_free(err);
+		g_key_file_free(new);
+		g_free(filename);
+		return FALSE;
+	}
+	g_free(filename);
+
+	if (keyFile == NULL) {
+		keyFile = new;
+		apply_prefs_changes(PREFS_CHANGE_ALL, ALSA_CHANGE_REINIT);
+		return FALSE;
+	}
+
+	changes = diff_prefs(keyFile, new, &alsa_change);
+	g_key_file_free(keyFile);
+	keyFile = new;
+
+	DEBUG_PRINT("Preferences reloaded, changes: 0x%x, alsa change: %d",
+		    changes, alsa_change);
+	apply_prefs_changes(changes, alsa_change);
+
+	return FALSE;
+}
+
+/**
+ * Handler for the signal 'changed' on the GFileMonitor prefs_monitor.
+ * Schedules a reload of the config file, so that a burst of events
+ * only causes one reload.
+ *
+ * @param monitor the monitor which received the signal
+ * @param file the file that changed
+ * @param other_file unused
+ * @param event_type the type of event
+ * @param data user data set when the signal handler was connected
+ */
+static void
+on_prefs_file_changed(G_GNUC_UNUSED GFileMonitor *monitor,
+		      G_GNUC_UNUSED GFile *file,
+		      G_GNUC_UNUSED GFile *other_file,
+		      GFileMonitorEvent event_type,
+		      G_GNUC_UNUSED gpointer data)
+{
+	switch (event_type) {
+	case G_FILE_MONITOR_EVENT_CHANGED:
+	case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+	case G_FILE_MONITOR_EVENT_CREATED:
+	case G_FILE_MONITOR_EVENT_DELETED:
+		break;
+	default:
+		return;
+	}
+
+	if (reload_id)
+		g_source_remove(reload_id);
+	reload_id = g_timeout_add(RELOAD_DELAY, reload_prefs, NULL);
+}
+
+/**
+ * Starts watching the config file, so that changes made by hand or by
+ * configuration management tools are applied without a restart.
+ * Does nothing if it's already watched.
+ */
+void
+prefs_start_watch(void)
+{
+	GFile *file;
+	gchar *filename;
+	GError *err = NULL;
+
+	if (prefs_monitor)
+		return;
+
+	filename = get_prefs_filename();
+	file = g_file_new_for_path(filename);
+	g_free(filename);
+
+	prefs_monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE,
+					    NULL, &err);
+	g_object_unref(file);
+
+	if (prefs_monitor == NULL) {
+		DEBUG_PRINT("Can't watch the config file: %s", err->message);
+		g_error_free(err);
+		return;
+	}
+
+	g_signal_connect(prefs_monitor, "changed",
+			 G_CALLBACK(on_prefs_file_changed), NULL);
+}
+
+/**
+ * Stops watching the config file.
+ */
+void
+prefs_stop_watch(void)
+{
+	if (reload_id) {
+		g_source_remove(reload_id);
+		reload_id = 0;
+	}
+
+	if (prefs_monitor) {
+		g_file_monitor_cancel(prefs_monitor);
+		g_object_unref(prefs_monitor);
+		prefs_monitor = NULL;
+	}
 }
 
 /**
@@ -513,14 +1315,15 @@ fill_card_combo(GtkWidget *combo, GtkWidget *channels_combo)
 	idx = 0;
 	while (cur_card) {
 		c = cur_card->data;
-		if (!c->channels) {
+		if (!get_card_channels(c)) {
 			cur_card = cur_card->next;
 			continue;
 		}
 		if (active_card && !strcmp(c->name, active_card->name)) {
 			gchar *sel_chan = prefs_get_channel(c->name);
 			sidx = idx;
-			fill_channel_combo(c->channels, channels_combo, sel_chan);
+			fill_channel_combo(get_card_channels(c), channels_combo,
+					   sel_chan);
 			if (sel_chan)
 				g_free(sel_chan);
 		}
@@ -533,6 +1336,46 @@ fill_card_combo(GtkWidget *combo, GtkWidget *channels_combo)
 	gtk_combo_box_set_active(GTK_COMBO_BOX(combo), sidx);
 }
 
+/**
+ * Handler for the signal 'query-tooltip' on the GtkComboBoxText widget
+ * card_combo. Shows the current levels of the selected card, which
+ * are known if it's the card in use or if its mixer is kept in the
+ * mixer pool (see MixerPoolSize).
+ *
+ * @param widget the object which received the signal
+ * @param x the x coordinate of the cursor position
+ * @param y the y coordinate of the cursor position
+ * @param keyboard_mode TRUE if the tooltip was triggered using the keyboard
+ * @param tooltip a GtkTooltip
+ * @param data user data set when the signal handler was connected
+ * @return TRUE if the tooltip should be shown
+ */
+static gboolean
+on_card_query_tooltip(GtkWidget *widget, G_GNUC_UNUSED gint x,
+		      G_GNUC_UNUSED gint y, G_GNUC_UNUSED gboolean keyboard_mode,
+		      GtkTooltip *tooltip, G_GNUC_UNUSED gpointer data)
+{
+	gchar *card_name, *text;
+	int vol, playing;
+	gboolean known;
+
+	card_name = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(widget));
+	known = card_name && alsa_get_card_levels(card_name, &vol, &playing);
+	g_free(card_name);
+
+	if (!known)
+		return FALSE;
+
+	if (playing)
+		text = g_strdup_printf(_("Volume: %d %%"), vol);
+	else
+		text = g_strdup_printf(_("Volume: %d %% (muted)"), vol);
+	gtk_tooltip_set_text(tooltip, text);
+	g_free(text);
+
+	return TRUE;
+}
+
 /**
  * Handler for the signal 'changed' on the GtkComboBoxText widget
  * card_combo. This basically refills the channel list if the card
@@ -553,7 +1396,8 @@ on_card_changed(GtkComboBox *box, PrefsData *data)
 
 	if (card) {
 		gchar *sel_chan = prefs_get_channel(card->name);
-		fill_channel_combo(card->channels, data->chan_combo, sel_chan);
+		fill_channel_combo(get_card_channels(card), data->chan_combo,
+				   sel_chan);
 		g_free(sel_chan);
 	}
 }
@@ -973,6 +1817,9 @@ create_prefs_window(void)
 
 	// fill in card/channel combo boxes
 	fill_card_combo(prefs_data->card_combo, prefs_data->chan_combo);
+	gtk_widget_set_has_tooltip(prefs_data->card_combo, TRUE);
+	g_signal_connect(G_OBJECT(prefs_data->card_combo), "query-tooltip",
+			 G_CALLBACK(on_card_query_tooltip), NULL);
 
 	// volume normalization (ALSA mapped)
 	gtk_toggle_button_set_active
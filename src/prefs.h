@@ -22,6 +22,52 @@
 
 #include "support.h"
 
+/**
+ * What changed in the alsa related preferences, passed
+ * to apply_prefs().
+ */
+enum alsa_change {
+	ALSA_CHANGE_NONE,	/**< nothing to do */
+	ALSA_CHANGE_CARD,	/**< the card changed, switch to it */
+	ALSA_CHANGE_CHANNEL,	/**< only the channel of the card changed */
+	ALSA_CHANGE_REINIT	/**< anything may have changed, reinitialize alsa */
+};
+
+/**
+ * Typed copy of the preferences read on hot paths, so that these
+ * don't need a GKeyFile lookup. It's parsed from the keyFile by
+ * prefs_load() and apply_prefs(), and must not be modified
+ * outside of prefs.c.
+ */
+struct settings {
+	/**
+	 * Bumped each time the settings are parsed, so that users can
+	 * tell whether something may have changed.
+	 */
+	guint generation;
+	/* volume */
+	gboolean normalize_volume;
+	gint ramp_duration;
+	gint slider_write_rate;
+	gint external_refresh_rate;
+	gint mixer_pool_size;
+	/* notifications */
+	gint noti_interval;
+	gint noti_burst;
+	gint noti_policy;
+	gboolean osd_enable;
+	/* mouse */
+	gint middle_click_action;
+	gchar *custom_command;
+	/* rendering */
+	gboolean system_theme;
+	gboolean draw_vol_meter;
+	gint vol_meter_style;
+	gint vol_meter_pos;
+};
+
+extern struct settings settings;
+
 gint scroll_step, fine_scroll_step;
 gboolean enable_noti, hotkey_noti, mouse_noti, popup_noti, external_noti;
 gint noti_timeout;
@@ -32,6 +78,7 @@ gint     prefs_get_integer(gchar *key, gint def);
 gdouble  prefs_get_double(gchar *key, gdouble def);
 gchar   *prefs_get_string(gchar *key, const gchar *def);
 gchar   *prefs_get_channel(const gchar *card);
+gchar  **prefs_get_group_members(const gchar *group);
 gchar   *prefs_get_vol_command(void);
 gdouble *prefs_get_vol_meter_colors(void);
 
@@ -44,7 +91,10 @@ void prefs_set_vol_meter_colors(gdouble *colors, gsize n);
 
 void prefs_load(void);
 void prefs_save(void);
+void prefs_flush(void);
 void prefs_ensure_save_dir(void);
+void prefs_start_watch(void);
+void prefs_stop_watch(void);
 
 GtkWidget *create_prefs_window(void);
 void apply_prefs(gint);